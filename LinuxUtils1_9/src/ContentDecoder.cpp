@@ -0,0 +1,184 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ContentDecoder.h"
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
+ContentDecoder::ContentDecoder()
+{
+	mode = IDENTITY;
+	streamOpen = false;
+	streamEnded = false;
+	sawInput = false;
+	rawDeflate = false;
+	producedOutput = false;
+	memset(&stream, 0, sizeof(stream));
+}
+
+ContentDecoder::~ContentDecoder()
+{
+	closeStream();
+}
+
+void ContentDecoder::closeStream()
+{
+	if (streamOpen)
+	{
+		inflateEnd(&stream);
+		streamOpen = false;
+	}
+}
+
+/*
+ * Gets ready for a new body sent with the given Content-Encoding header
+ * (empty for none). Returns false if the encoding is not supported.
+ */
+bool ContentDecoder::begin(const std::string& contentEncoding)
+{
+	closeStream();
+	std::string encoding = contentEncoding;
+	std::transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+	streamEnded = false;
+	sawInput = false;
+	rawDeflate = false;
+	producedOutput = false;
+	replay.clear();
+	if ((encoding.length() == 0) || (encoding == "identity"))
+	{
+		mode = IDENTITY;
+		return true;
+	}
+	if ((encoding != "gzip") && (encoding != "x-gzip") && (encoding != "deflate"))
+	{
+		return false;
+	}
+	mode = INFLATE;
+	memset(&stream, 0, sizeof(stream));
+	// 15 + 32 lets zlib tell a gzip header from a zlib one by itself
+	streamOpen = (inflateInit2(&stream, 15 + 32) == Z_OK);
+	return streamOpen;
+}
+
+/*
+ * Decodes the next 'length' bytes of the body onto the end of 'target'.
+ * Returns false if the data is corrupt.
+ */
+bool ContentDecoder::decode(const char* data, size_t length, std::string& target)
+{
+	if (mode == IDENTITY)
+	{
+		target.append(data, length);
+		return true;
+	}
+	if (length == 0)
+	{
+		return true;
+	}
+	size_t targetLength = target.length();
+	sawInput = true;
+	if (inflateInto(data, length, target))
+	{
+		if (!producedOutput && !rawDeflate)
+		{
+			producedOutput = (target.length() != targetLength) || streamEnded;
+			if (producedOutput)
+			{
+				replay.clear();
+			}
+			else
+			{
+				replay.append(data, length);
+			}
+		}
+		return true;
+	}
+	if (producedOutput || rawDeflate)
+	{
+		return false;
+	}
+	// a "deflate" body without the zlib wrapper, so start again expecting raw data
+	target.resize(targetLength);
+	replay.append(data, length);
+	closeStream();
+	memset(&stream, 0, sizeof(stream));
+	streamOpen = (inflateInit2(&stream, -15) == Z_OK);
+	rawDeflate = true;
+	streamEnded = false;
+	bool decoded = streamOpen && inflateInto(replay.data(), replay.length(), target);
+	replay.clear();
+	return decoded;
+}
+
+bool ContentDecoder::inflateInto(const char* data, size_t length, std::string& target)
+{
+	char block[16384];
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = length;
+	while (stream.avail_in > 0)
+	{
+		if (streamEnded)
+		{
+			// another gzip member follows the one just finished
+			if (inflateReset(&stream) != Z_OK)
+			{
+				return false;
+			}
+			streamEnded = false;
+		}
+		stream.next_out = (Bytef*) block;
+		stream.avail_out = sizeof(block);
+		int result = inflate(&stream, Z_NO_FLUSH);
+		target.append(block, sizeof(block) - stream.avail_out);
+		if (result == Z_STREAM_END)
+		{
+			streamEnded = true;
+		}
+		else if ((result != Z_OK) && !((result == Z_BUF_ERROR) && (stream.avail_out != 0)))
+		{
+			return false;
+		}
+	}
+	// drain anything zlib is still holding back
+	while (!streamEnded)
+	{
+		stream.next_out = (Bytef*) block;
+		stream.avail_out = sizeof(block);
+		int result = inflate(&stream, Z_NO_FLUSH);
+		target.append(block, sizeof(block) - stream.avail_out);
+		if (result == Z_STREAM_END)
+		{
+			streamEnded = true;
+		}
+		else if ((result != Z_OK) || (stream.avail_out != 0))
+		{
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Call once the whole body has been passed to decode(). Returns false if
+ * the compressed stream stopped short.
+ */
+bool ContentDecoder::finish()
+{
+	bool complete = (mode == IDENTITY) || streamEnded || !sawInput;
+	closeStream();
+	return complete;
+}
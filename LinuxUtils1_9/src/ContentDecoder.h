@@ -0,0 +1,39 @@
+#ifndef CONTENTDECODER_H_
+#define CONTENTDECODER_H_
+
+#include <string>
+#include <stddef.h>
+#include <zlib.h>
+
+/*
+ * Undoes an HTTP Content-Encoding a piece at a time, as the body arrives,
+ * so the compressed form is never held in full. Handles "gzip",
+ * "deflate" (zlib wrapped, or raw as some servers send it) and
+ * "identity"; anything else is refused by begin().
+ */
+class ContentDecoder
+{
+	public:
+		ContentDecoder();
+		virtual ~ContentDecoder();
+		bool begin(const std::string& contentEncoding);
+		bool decode(const char* data, size_t length, std::string& target);
+		bool finish();
+	private:
+		enum
+		{
+			IDENTITY, INFLATE
+		};
+		int mode;
+		bool streamOpen;
+		bool streamEnded;
+		bool sawInput;
+		bool rawDeflate;
+		bool producedOutput;
+		std::string replay; // input seen before any output, in case it turns out to be raw deflate
+		z_stream stream;
+		void closeStream();
+		bool inflateInto(const char* data, size_t length, std::string& target);
+};
+
+#endif /* CONTENTDECODER_H_ */
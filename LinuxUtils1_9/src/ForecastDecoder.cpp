@@ -0,0 +1,90 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ForecastDecoder.h"
+#include <string>
+
+ForecastDecoder::ForecastDecoder()
+{
+}
+
+ForecastDecoder::~ForecastDecoder()
+{
+}
+
+bool ForecastDecoder::beginStream(const std::string&, const char*, size_t)
+{
+	return false;
+}
+
+void ForecastDecoder::feedStream(const char*, size_t)
+{
+}
+
+bool ForecastDecoder::finishStream(FORECAST*)
+{
+	return false;
+}
+
+/*
+ * The first character of 'data' that is not white space (skipping a UTF-8
+ * byte order mark), or 0 if there is none.
+ */
+char ForecastDecoder::firstSignificant(const char* data, size_t length)
+{
+	size_t pos = 0;
+	if ((length >= 3) && (data[0] == '\xEF') && (data[1] == '\xBB') && (data[2] == '\xBF'))
+	{
+		pos = 3;
+	}
+	while ((pos < length) && ((data[pos] == ' ') || (data[pos] == '\t') || (data[pos] == '\r') || (data[pos]
+			== '\n')))
+	{
+		pos++;
+	}
+	return (pos < length) ? data[pos] : 0;
+}
+
+/*
+ * Reads the integer at the start of 'text' (after any spaces), stopping at
+ * the first non-digit, as in "18°C" or "10mph". Leaves 'value' untouched
+ * and returns false if there is no number.
+ */
+bool ForecastDecoder::spanToInt(XMLSpan text, int& value)
+{
+	size_t pos = 0;
+	while ((pos < text.length) && (text.data[pos] == ' '))
+	{
+		pos++;
+	}
+	bool negative = (pos < text.length) && (text.data[pos] == '-');
+	if (negative || ((pos < text.length) && (text.data[pos] == '+')))
+	{
+		pos++;
+	}
+	size_t firstDigit = pos;
+	int result = 0;
+	while ((pos < text.length) && (text.data[pos] >= '0') && (text.data[pos] <= '9') && (pos - firstDigit < 9))
+	{
+		result = result * 10 + (text.data[pos] - '0');
+		pos++;
+	}
+	if (pos == firstDigit)
+	{
+		return false;
+	}
+	value = negative ? -result : result;
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef FORECASTDECODER_H_
+#define FORECASTDECODER_H_
+
+#include <string>
+#include <stddef.h>
+#include "XMLSpan.h"
+
+/*
+ * Turns one feed layout into three days of forecast. WeatherData keeps a
+ * list of these and hands a fetched body to the first that accepts it, so
+ * a new source only needs a new subclass.
+ */
+class ForecastDecoder
+{
+	public:
+		struct FORECAST
+		{
+				std::string day;
+				std::string description;
+				int maxTemp; // Celsius
+				int minTemp; // Celsius
+				std::string windDirection;
+				int windSpeed; // mph
+		};
+		ForecastDecoder();
+		virtual ~ForecastDecoder();
+		/*
+		 * Whether this decoder reads the body, going by its Content-Type
+		 * (may be empty) and, failing that, its first bytes.
+		 */
+		virtual bool accepts(const std::string& contentType, const char* data, size_t length) = 0;
+		/*
+		 * Fills in day[0] to day[2]. 'data' is only borrowed for the call.
+		 * Returns false if the body does not hold a forecast.
+		 */
+		virtual bool decode(const char* data, size_t length, FORECAST* day) = 0;
+		/*
+		 * Optional form of decode() for a body still arriving. Offered
+		 * the first block, beginStream() returns true to take the rest
+		 * through feedStream(); finishStream() then fills in the days,
+		 * or returns false so the caller falls back to decode() on the
+		 * whole body. The defaults decline.
+		 */
+		virtual bool beginStream(const std::string& contentType, const char* data, size_t length);
+		virtual void feedStream(const char* data, size_t length);
+		virtual bool finishStream(FORECAST* day);
+	protected:
+		static char firstSignificant(const char* data, size_t length);
+		static bool spanToInt(XMLSpan text, int& value);
+};
+
+#endif /* FORECASTDECODER_H_ */
@@ -0,0 +1,182 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ForecastHistory.h"
+#include <string>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char HISTORY_MAGIC[8] =
+{ 'L', 'U', 'W', 'H', 'I', 'S', 'T', '1' };
+
+const size_t ForecastHistory::CAPACITY;
+const size_t ForecastHistory::FILE_SIZE;
+
+ForecastHistory::ForecastHistory()
+{
+	fileDescriptor = -1;
+	header = NULL;
+	records = NULL;
+}
+
+ForecastHistory::~ForecastHistory()
+{
+	closeFile();
+}
+
+/*
+ * Maps the history file at 'path', creating it, or starting it afresh if
+ * it is not a history of the expected layout.
+ */
+bool ForecastHistory::openFile(const std::string& path)
+{
+	closeFile();
+	if (path.length() == 0)
+	{
+		return false;
+	}
+	int handle = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+	if (handle == -1)
+	{
+		return false;
+	}
+	flock(handle, LOCK_EX);
+	struct stat fileInfo;
+	if ((fstat(handle, &fileInfo) != 0) || (fileInfo.st_size != (off_t) FILE_SIZE))
+	{
+		// zero filled, so the magic check below starts it afresh
+		if ((ftruncate(handle, 0) != 0) || (ftruncate(handle, FILE_SIZE) != 0))
+		{
+			flock(handle, LOCK_UN);
+			close(handle);
+			return false;
+		}
+	}
+	void* mapping = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+	if (mapping == MAP_FAILED)
+	{
+		flock(handle, LOCK_UN);
+		close(handle);
+		return false;
+	}
+	header = (HEADER*) mapping;
+	records = (RECORD*) ((char*) mapping + sizeof(HEADER));
+	if ((memcmp(header->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0) || (header->recordSize
+			!= sizeof(RECORD)) || (header->capacity != CAPACITY))
+	{
+		memset(mapping, 0, FILE_SIZE);
+		memcpy(header->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+		header->recordSize = sizeof(RECORD);
+		header->capacity = CAPACITY;
+	}
+	flock(handle, LOCK_UN);
+	fileDescriptor = handle;
+	return true;
+}
+
+void ForecastHistory::closeFile()
+{
+	if (header != NULL)
+	{
+		munmap(header, FILE_SIZE);
+		header = NULL;
+		records = NULL;
+	}
+	if (fileDescriptor != -1)
+	{
+		close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+}
+
+static int8_t clampTemperature(int value)
+{
+	return (int8_t) ((value < -128) ? -128 : ((value > 127) ? 127 : value));
+}
+
+/*
+ * Writes the forecast over the oldest slot. The file lock keeps appends
+ * from several processes apart; readers take no lock, so the record's
+ * sequence is cleared while it is rewritten and only set once it is whole.
+ */
+bool ForecastHistory::append(time_t fetched, const ForecastDecoder::FORECAST* day)
+{
+	if (header == NULL)
+	{
+		return false;
+	}
+	flock(fileDescriptor, LOCK_EX);
+	uint64_t position = header->appended;
+	RECORD& record = records[position % CAPACITY];
+	__atomic_store_n(&record.sequence, 0, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	record.fetched = fetched;
+	for (int thisDay = 0; thisDay < 3; thisDay++)
+	{
+		record.maxTemp[thisDay] = clampTemperature(day[thisDay].maxTemp);
+		record.minTemp[thisDay] = clampTemperature(day[thisDay].minTemp);
+		int speed = day[thisDay].windSpeed;
+		record.windSpeed[thisDay] = (uint8_t) ((speed < 0) ? 0 : ((speed > 255) ? 255 : speed));
+	}
+	memset(record.reserved, 0, sizeof(record.reserved));
+	__atomic_store_n(&record.sequence, (uint32_t) (position + 1), __ATOMIC_RELEASE);
+	__atomic_store_n(&header->appended, position + 1, __ATOMIC_RELEASE);
+	flock(fileDescriptor, LOCK_UN);
+	return true;
+}
+
+/*
+ * Number of records held, at most CAPACITY.
+ */
+size_t ForecastHistory::getCount()
+{
+	if (header == NULL)
+	{
+		return 0;
+	}
+	uint64_t appended = __atomic_load_n(&header->appended, __ATOMIC_ACQUIRE);
+	return (appended < CAPACITY) ? (size_t) appended : CAPACITY;
+}
+
+/*
+ * Copies out the record 'age' appends ago (0 is the newest). Returns false
+ * if there is no such record, or it was overwritten while being read.
+ */
+bool ForecastHistory::getRecord(size_t age, RECORD& record)
+{
+	if (header == NULL)
+	{
+		return false;
+	}
+	uint64_t appended = __atomic_load_n(&header->appended, __ATOMIC_ACQUIRE);
+	if ((age >= CAPACITY) || (age >= appended))
+	{
+		return false;
+	}
+	uint64_t position = appended - 1 - age;
+	const RECORD& slot = records[position % CAPACITY];
+	uint32_t expected = (uint32_t) (position + 1);
+	if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != expected)
+	{
+		return false;
+	}
+	memcpy(&record, &slot, sizeof(RECORD));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == expected;
+}
@@ -0,0 +1,52 @@
+#ifndef FORECASTHISTORY_H_
+#define FORECASTHISTORY_H_
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "ForecastDecoder.h"
+
+/*
+ * The last CAPACITY forecasts for one feed, kept in a fixed-size file of
+ * binary records that is mapped into memory. The file never grows: each
+ * append overwrites the oldest slot, so it stays the same size however
+ * long the utility runs. Any process can map the same file and read
+ * records straight out of it; a record being rewritten while it is read
+ * is detected and skipped.
+ */
+class ForecastHistory
+{
+	public:
+		struct RECORD
+		{
+				int64_t fetched; // seconds since the epoch
+				uint32_t sequence; // 1 + position in the history, 0 while being written
+				int8_t maxTemp[3]; // Celsius, for today and the next two days
+				int8_t minTemp[3];
+				uint8_t windSpeed[3]; // mph
+				uint8_t reserved[3];
+		};
+		static const size_t CAPACITY = 512;
+		ForecastHistory();
+		virtual ~ForecastHistory();
+		bool openFile(const std::string& path);
+		void closeFile();
+		bool append(time_t fetched, const ForecastDecoder::FORECAST* day);
+		size_t getCount();
+		bool getRecord(size_t age, RECORD& record);
+	private:
+		struct HEADER
+		{
+				char magic[8];
+				uint32_t recordSize;
+				uint32_t capacity;
+				uint64_t appended; // records ever appended
+		};
+		static const size_t FILE_SIZE = sizeof(HEADER) + CAPACITY * sizeof(RECORD);
+		int fileDescriptor; // kept open to lock appends
+		HEADER* header;
+		RECORD* records;
+};
+
+#endif /* FORECASTHISTORY_H_ */
@@ -0,0 +1,151 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "GammaApplier.h"
+
+GammaApplier::GammaApplier(double maxGamma)
+{
+	this->maxGamma = maxGamma;
+	pendingSet = false;
+	lastPostedSet = false;
+	stopping = false;
+	stats.applied = 0;
+	stats.coalesced = 0;
+	stats.skipped = 0;
+	pthread_mutex_init(&mailboxLock, NULL);
+	pthread_cond_init(&mailboxFilled, NULL);
+	gammaRamp = new GammaRamp();
+	threadStarted = (pthread_create(&threadMethod, 0, GammaApplier::start_thread, this) == 0);
+	if (!threadStarted)
+	{
+		// post() applies in the caller instead
+		gammaRamp->open();
+	}
+}
+
+/*
+ * Applies whatever was last posted before returning, so the final value
+ * of a drag is never lost on exit.
+ */
+GammaApplier::~GammaApplier()
+{
+	if (threadStarted)
+	{
+		pthread_mutex_lock(&mailboxLock);
+		stopping = true;
+		pthread_cond_signal(&mailboxFilled);
+		pthread_mutex_unlock(&mailboxLock);
+		pthread_join(threadMethod, NULL);
+	}
+	delete gammaRamp;
+	pthread_cond_destroy(&mailboxFilled);
+	pthread_mutex_destroy(&mailboxLock);
+}
+
+/*
+ * Hands the applier the slider values (0 - 100, alpha scaling the other
+ * three) and returns straight away. Values equal to the last ones posted
+ * are dropped without reaching the applier or its stats.
+ */
+void GammaApplier::post(float red, float green, float blue, float alpha)
+{
+	TARGET target;
+	target.red = red;
+	target.green = green;
+	target.blue = blue;
+	target.alpha = alpha;
+	if (lastPostedSet && (lastPosted.red == red) && (lastPosted.green == green) && (lastPosted.blue == blue)
+			&& (lastPosted.alpha == alpha))
+	{
+		return;
+	}
+	lastPosted = target;
+	lastPostedSet = true;
+	if (!threadStarted)
+	{
+		applyTarget(target);
+		return;
+	}
+	pthread_mutex_lock(&mailboxLock);
+	if (pendingSet)
+	{
+		stats.coalesced++;
+	}
+	pending = target;
+	pendingSet = true;
+	pthread_cond_signal(&mailboxFilled);
+	pthread_mutex_unlock(&mailboxLock);
+}
+
+GammaApplier::APPLY_STATS GammaApplier::getStats()
+{
+	pthread_mutex_lock(&mailboxLock);
+	APPLY_STATS copy = stats;
+	pthread_mutex_unlock(&mailboxLock);
+	return copy;
+}
+
+void* GammaApplier::start_thread(void *obj)
+{
+	GammaApplier* thisClass = static_cast<GammaApplier*> (obj);
+	thisClass->applyThread();
+	return 0;
+}
+
+void GammaApplier::applyThread()
+{
+	// The X connection is opened here and only ever used from this thread
+	gammaRamp->open();
+	pthread_mutex_lock(&mailboxLock);
+	while (true)
+	{
+		while (!pendingSet && !stopping)
+		{
+			pthread_cond_wait(&mailboxFilled, &mailboxLock);
+		}
+		if (!pendingSet)
+		{
+			break;
+		}
+		TARGET target = pending;
+		pendingSet = false;
+		pthread_mutex_unlock(&mailboxLock);
+		applyTarget(target);
+		pthread_mutex_lock(&mailboxLock);
+	}
+	pthread_mutex_unlock(&mailboxLock);
+}
+
+/*
+ * Maps the percentages onto 0.1 > maxGamma and sets the ramps.
+ */
+void GammaApplier::applyTarget(const TARGET& target)
+{
+	double scaleFactor = ((maxGamma - 0.1) / 100);
+	double rVal = 0.1 + (target.red * (target.alpha / 100) * scaleFactor);
+	double gVal = 0.1 + (target.green * (target.alpha / 100) * scaleFactor);
+	double bVal = 0.1 + (target.blue * (target.alpha / 100) * scaleFactor);
+	GammaRamp::ApplyResult result = gammaRamp->apply(rVal, gVal, bVal);
+	pthread_mutex_lock(&mailboxLock);
+	if (result == GammaRamp::APPLY_SENT)
+	{
+		stats.applied++;
+	}
+	else if (result == GammaRamp::APPLY_UNCHANGED)
+	{
+		stats.skipped++;
+	}
+	pthread_mutex_unlock(&mailboxLock);
+}
@@ -0,0 +1,48 @@
+#ifndef GAMMAAPPLIER_H_
+#define GAMMAAPPLIER_H_
+
+#include <pthread.h>
+#include "GammaRamp.h"
+
+/*
+ * Applies gamma changes on a thread of its own, so the event loop never
+ * waits for the X server. Posting overwrites a single slot: the thread
+ * takes whatever is there when it is next free, so values posted faster
+ * than the ramps can be sent are dropped rather than queued.
+ */
+class GammaApplier
+{
+	public:
+		GammaApplier(double maxGamma);
+		virtual ~GammaApplier();
+		void post(float red, float green, float blue, float alpha);
+		struct APPLY_STATS
+		{
+				unsigned long applied; // ramps sent to the server
+				unsigned long coalesced; // posts replaced before the thread got to them
+				unsigned long skipped; // ramp updates made that left the ramps as they were
+		};
+		APPLY_STATS getStats();
+	private:
+		struct TARGET
+		{
+				float red, green, blue, alpha; // slider percentages
+		};
+		static void* start_thread(void *obj);
+		void applyThread();
+		void applyTarget(const TARGET& target);
+		double maxGamma;
+		GammaRamp* gammaRamp; // only used by the applier thread once it is running
+		pthread_t threadMethod;
+		bool threadStarted;
+		pthread_mutex_t mailboxLock;
+		pthread_cond_t mailboxFilled; // signalled on a post and on shutdown
+		TARGET pending;
+		bool pendingSet;
+		TARGET lastPosted; // main thread only
+		bool lastPostedSet;
+		bool stopping;
+		APPLY_STATS stats;
+};
+
+#endif /* GAMMAAPPLIER_H_ */
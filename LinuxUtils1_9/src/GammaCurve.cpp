@@ -0,0 +1,228 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "GammaCurve.h"
+#include <math.h>
+#include <stdlib.h>
+#include "ScannerSupport.h"
+
+GammaCurve::GammaCurve(size_t capacity)
+{
+	this->capacity = (capacity < 1) ? 1 : capacity;
+	useCount = 0;
+	stats.hits = 0;
+	stats.misses = 0;
+}
+
+GammaCurve::~GammaCurve()
+{
+	for (size_t entry = 0; entry < entries.size(); entry++)
+	{
+		delete entries[entry];
+	}
+}
+
+/*
+ * Returns the red, green and blue ramps, 'size' entries each and one
+ * after the other, from the cache or freshly built over the least
+ * recently used set. Valid until the next call.
+ */
+const unsigned short* GammaCurve::getRamps(int size, double redGamma, double greenGamma, double blueGamma)
+{
+	int gamma[3] = { quantize(redGamma), quantize(greenGamma), quantize(blueGamma) };
+	useCount++;
+	ENTRY* oldest = NULL;
+	for (size_t entry = 0; entry < entries.size(); entry++)
+	{
+		ENTRY* candidate = entries[entry];
+		if ((candidate->size == size) && (candidate->gamma[0] == gamma[0]) && (candidate->gamma[1] == gamma[1])
+				&& (candidate->gamma[2] == gamma[2]))
+		{
+			candidate->lastUsed = useCount;
+			stats.hits++;
+			return &candidate->ramps[0];
+		}
+		if ((oldest == NULL) || (candidate->lastUsed < oldest->lastUsed))
+		{
+			oldest = candidate;
+		}
+	}
+	stats.misses++;
+	if (entries.size() < capacity)
+	{
+		oldest = new ENTRY();
+		entries.push_back(oldest);
+	}
+	oldest->size = size;
+	oldest->lastUsed = useCount;
+	oldest->ramps.resize(size * 3);
+	for (int channel = 0; channel < 3; channel++)
+	{
+		oldest->gamma[channel] = gamma[channel];
+		fill(&oldest->ramps[channel * size], size, gamma[channel] / 65536.0);
+	}
+	return &oldest->ramps[0];
+}
+
+GammaCurve::CACHE_STATS GammaCurve::getStats()
+{
+	return stats;
+}
+
+void GammaCurve::fill(unsigned short* ramp, int size, double gamma)
+{
+	int entry = fillSSE2(ramp, size, gamma);
+	double exponent = 1.0 / gamma;
+	for (; entry < size; entry++)
+	{
+		double value = pow((double) entry / (size - 1), exponent) * 65535.0 + 0.5;
+		ramp[entry] = (unsigned short) ((value > 65535.0) ? 65535.0 : value);
+	}
+	if (size > 0)
+	{
+		// 0 ^ anything positive, which the log below cannot give exactly
+		ramp[0] = 0;
+	}
+}
+
+/*
+ * The same curve the X server builds for xgamma, one pow() per entry.
+ */
+void GammaCurve::fillReference(unsigned short* ramp, int size, double gamma)
+{
+	double exponent = 1.0 / gamma;
+	for (int entry = 0; entry < size; entry++)
+	{
+		double value = pow((double) entry / (size - 1), exponent) * 65535.0 + 0.5;
+		ramp[entry] = (unsigned short) ((value > 65535.0) ? 65535.0 : value);
+	}
+}
+
+/*
+ * Builds ramps of the sizes X servers report, over gammas 0.1 to 4.0,
+ * both ways and returns the largest difference found, in counts.
+ */
+int GammaCurve::compareWithReference()
+{
+	static const int sizes[] = { 256, 1024, 2048, 4096 };
+	std::vector<unsigned short> fast(4096), reference(4096);
+	int worst = 0;
+	for (size_t sizeIndex = 0; sizeIndex < sizeof(sizes) / sizeof(sizes[0]); sizeIndex++)
+	{
+		int size = sizes[sizeIndex];
+		for (int step = 10; step <= 400; step++)
+		{
+			fill(&fast[0], size, step / 100.0);
+			fillReference(&reference[0], size, step / 100.0);
+			for (int entry = 0; entry < size; entry++)
+			{
+				int difference = abs((int) fast[entry] - (int) reference[entry]);
+				worst = (difference > worst) ? difference : worst;
+			}
+		}
+	}
+	return worst;
+}
+
+int GammaCurve::quantize(double gamma)
+{
+	return (int) floor(gamma * 65536.0 + 0.5);
+}
+
+#ifdef SCANNER_X86
+
+/*
+ * x ^ e as exp(e * ln(x)), using the Cephes single precision polynomials
+ * for ln and exp. Float is plenty: an entry only needs to be right to
+ * 1 part in 65535. Returns how many entries were done, leaving any tail
+ * of fewer than four to the caller.
+ */
+int GammaCurve::fillSSE2(unsigned short* ramp, int size, double gamma)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 exponent = _mm_set1_ps((float) (1.0 / gamma));
+	const __m128 step = _mm_set1_ps(1.0f / (size - 1));
+	const __m128 smallest = _mm_set1_ps(1.17549435e-38f); // least normal float, for ln(0)
+	const __m128i mantissaMask = _mm_set1_epi32(~0x7f800000);
+	const __m128 sqrtHalf = _mm_set1_ps(0.707106781186547524f);
+	const __m128 lnHigh = _mm_set1_ps(0.693359375f); // ln(2) split in two for precision
+	const __m128 lnLow = _mm_set1_ps(-2.12194440e-4f);
+	const __m128 scale = _mm_set1_ps(65535.0f);
+	const __m128 bias = _mm_set1_ps(32768.0f);
+	__m128 index = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+	int entry = 0;
+	for (; entry + 4 <= size; entry += 4)
+	{
+		__m128 x = _mm_max_ps(_mm_mul_ps(index, step), smallest);
+		index = _mm_add_ps(index, four);
+
+		// ln(x): split x into 2^e * m with m in [sqrt(0.5), sqrt(2)), then a polynomial in m - 1
+		__m128i bits = _mm_castps_si128(x);
+		__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0x7e)));
+		__m128 m = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(mantissaMask)), half);
+		__m128 small = _mm_cmplt_ps(m, sqrtHalf);
+		e = _mm_sub_ps(e, _mm_and_ps(one, small));
+		m = _mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(m, small));
+		__m128 m2 = _mm_mul_ps(m, m);
+		__m128 poly = _mm_set1_ps(7.0376836292E-2f);
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(-1.1514610310E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(1.1676998740E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(-1.2420140846E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(1.4249322787E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(-1.6668057665E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(2.0000714765E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(-2.4999993993E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, m), _mm_set1_ps(3.3333331174E-1f));
+		poly = _mm_mul_ps(_mm_mul_ps(poly, m), m2);
+		poly = _mm_add_ps(poly, _mm_mul_ps(e, lnLow));
+		poly = _mm_sub_ps(poly, _mm_mul_ps(m2, half));
+		__m128 ln = _mm_add_ps(_mm_add_ps(m, poly), _mm_mul_ps(e, lnHigh));
+
+		// exp(y): y = n ln(2) + r with |r| <= ln(2) / 2, then 2^n * a polynomial in r
+		__m128 y = _mm_max_ps(_mm_mul_ps(ln, exponent), _mm_set1_ps(-87.3f));
+		__m128 n = _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(1.44269504088896341f)), half);
+		__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(n));
+		n = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, n), one)); // floor
+		__m128 r = _mm_sub_ps(_mm_sub_ps(y, _mm_mul_ps(n, lnHigh)), _mm_mul_ps(n, lnLow));
+		__m128 r2 = _mm_mul_ps(r, r);
+		poly = _mm_set1_ps(1.9875691500E-4f);
+		poly = _mm_add_ps(_mm_mul_ps(poly, r), _mm_set1_ps(1.3981999507E-3f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, r), _mm_set1_ps(8.3334519073E-3f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, r), _mm_set1_ps(4.1665795894E-2f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, r), _mm_set1_ps(1.6666665459E-1f));
+		poly = _mm_add_ps(_mm_mul_ps(poly, r), _mm_set1_ps(5.0000001201E-1f));
+		poly = _mm_add_ps(_mm_add_ps(_mm_mul_ps(poly, r2), r), one);
+		__m128i power = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(0x7f)), 23);
+		__m128 value = _mm_mul_ps(poly, _mm_castsi128_ps(power));
+
+		// Scale, round and clamp, then pack to 16 bits via the signed range
+		value = _mm_min_ps(_mm_add_ps(_mm_mul_ps(value, scale), half), scale);
+		__m128i counts = _mm_sub_epi32(_mm_cvttps_epi32(value), _mm_cvttps_epi32(bias));
+		__m128i packed = _mm_xor_si128(_mm_packs_epi32(counts, counts), _mm_set1_epi16((short) 0x8000));
+		_mm_storel_epi64((__m128i*) (ramp + entry), packed);
+	}
+	return entry;
+}
+
+#else
+
+int GammaCurve::fillSSE2(unsigned short*, int, double)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef GAMMACURVE_H_
+#define GAMMACURVE_H_
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Builds gamma ramps: entry i of a ramp of n is (i / (n - 1)) ^ (1 / gamma)
+ * scaled to 0..65535. On x86 the curve is evaluated four entries at a
+ * time with SSE2 exp/log approximations (within a count of pow() over the
+ * gammas this utility uses); elsewhere pow() is called per entry.
+ *
+ * Each instance also keeps the last few red, green and blue ramp sets it
+ * built, keyed by ramp size and gamma rounded to 1/65536, so dragging a
+ * slider back over the same values or replaying a preset reuses them.
+ */
+class GammaCurve
+{
+	public:
+		GammaCurve(size_t capacity = 16);
+		virtual ~GammaCurve();
+		const unsigned short* getRamps(int size, double redGamma, double greenGamma, double blueGamma);
+		struct CACHE_STATS
+		{
+				unsigned long hits;
+				unsigned long misses;
+		};
+		CACHE_STATS getStats();
+		static void fill(unsigned short* ramp, int size, double gamma);
+		static void fillReference(unsigned short* ramp, int size, double gamma);
+		static int compareWithReference();
+	private:
+		struct ENTRY
+		{
+				int size;
+				int gamma[3]; // quantized red, green and blue
+				unsigned long lastUsed;
+				std::vector<unsigned short> ramps; // red, green then blue
+		};
+		static int quantize(double gamma);
+		static int fillSSE2(unsigned short* ramp, int size, double gamma);
+		size_t capacity;
+		unsigned long useCount;
+		std::vector<ENTRY*> entries;
+		CACHE_STATS stats;
+};
+
+#endif /* GAMMACURVE_H_ */
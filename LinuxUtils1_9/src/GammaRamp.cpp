@@ -0,0 +1,436 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "GammaRamp.h"
+#include <vector>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/xf86vmode.h>
+
+/*
+ * X errors go to a single process wide handler. Every connection a
+ * GammaRamp has open is registered here and the errors on it are counted
+ * instead; errors on any other connection, such as SDL's, still reach the
+ * handler installed before. The handler is installed with the first
+ * registration and restored with the last.
+ */
+struct TRAPPED_DISPLAY
+{
+	Display* display;
+	int errors;
+};
+
+static pthread_mutex_t trapLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<TRAPPED_DISPLAY> trappedDisplays;
+static XErrorHandler previousErrorHandler = NULL;
+
+static int trapError(Display* display, XErrorEvent* error)
+{
+	pthread_mutex_lock(&trapLock);
+	for (size_t trapped = 0; trapped < trappedDisplays.size(); trapped++)
+	{
+		if (trappedDisplays[trapped].display == display)
+		{
+			trappedDisplays[trapped].errors++;
+			pthread_mutex_unlock(&trapLock);
+			return 0;
+		}
+	}
+	XErrorHandler previous = previousErrorHandler;
+	pthread_mutex_unlock(&trapLock);
+	return (previous != NULL) ? previous(display, error) : 0;
+}
+
+static void trapDisplay(Display* display)
+{
+	TRAPPED_DISPLAY trapped = { display, 0 };
+	pthread_mutex_lock(&trapLock);
+	trappedDisplays.push_back(trapped);
+	if (trappedDisplays.size() == 1)
+	{
+		previousErrorHandler = XSetErrorHandler(trapError);
+	}
+	pthread_mutex_unlock(&trapLock);
+}
+
+static void untrapDisplay(Display* display)
+{
+	pthread_mutex_lock(&trapLock);
+	for (size_t trapped = 0; trapped < trappedDisplays.size(); trapped++)
+	{
+		if (trappedDisplays[trapped].display == display)
+		{
+			trappedDisplays.erase(trappedDisplays.begin() + trapped);
+			if (trappedDisplays.empty())
+			{
+				XSetErrorHandler(previousErrorHandler);
+				previousErrorHandler = NULL;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&trapLock);
+}
+
+static int trappedErrors(Display* display)
+{
+	int errors = 0;
+	pthread_mutex_lock(&trapLock);
+	for (size_t trapped = 0; trapped < trappedDisplays.size(); trapped++)
+	{
+		if (trappedDisplays[trapped].display == display)
+		{
+			errors = trappedDisplays[trapped].errors;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&trapLock);
+	return errors;
+}
+
+/*
+ * The applier drives its connection from its own thread while SDL uses
+ * X on the main one, so Xlib has to be made thread safe before any
+ * connection is opened.
+ */
+void GammaRamp::initThreads()
+{
+	XInitThreads();
+}
+
+GammaRamp::GammaRamp()
+{
+	display = NULL;
+	errorsSeen = 0;
+	backend = BACKEND_XGAMMA;
+	screenNumber = 0;
+	vidModeRampSize = 0;
+	rampsSent = false;
+}
+
+GammaRamp::~GammaRamp()
+{
+	close();
+}
+
+/*
+ * Connects to $DISPLAY and picks the first backend, starting from
+ * 'preferred', that this server supports. Returns false if only the
+ * xgamma fallback is left.
+ */
+bool GammaRamp::open(Backend preferred)
+{
+	close();
+	if (preferred != BACKEND_XGAMMA)
+	{
+		display = XOpenDisplay(NULL);
+	}
+	if (display != NULL)
+	{
+		trapDisplay(display);
+		errorsSeen = 0;
+		screenNumber = DefaultScreen(display);
+		if ((preferred == BACKEND_XRANDR) && openXRandR() && probeXRandR())
+		{
+			backend = BACKEND_XRANDR;
+			return true;
+		}
+		releaseXRandR();
+		if (openVidMode() && probeVidMode())
+		{
+			backend = BACKEND_VIDMODE;
+			return true;
+		}
+		close();
+	}
+	backend = BACKEND_XGAMMA;
+	return false;
+}
+
+/*
+ * The ramps are left as they were last set: the gamma is meant to stay
+ * after the utility exits, as it did with xgamma.
+ */
+void GammaRamp::close()
+{
+	releaseXRandR();
+	vidModeRamp.clear();
+	vidModeRampSize = 0;
+	rampsSent = false;
+	if (display != NULL)
+	{
+		// still trapped while closing, since that flushes anything queued
+		XCloseDisplay(display);
+		untrapDisplay(display);
+		display = NULL;
+	}
+	backend = BACKEND_XGAMMA;
+}
+
+void GammaRamp::releaseXRandR()
+{
+	for (size_t crtc = 0; crtc < crtcRamps.size(); crtc++)
+	{
+		XRRFreeGamma(crtcRamps[crtc]);
+	}
+	crtcRamps.clear();
+	crtcs.clear();
+}
+
+bool GammaRamp::openXRandR()
+{
+	int eventBase, errorBase, major = 0, minor = 0;
+	if (!XRRQueryExtension(display, &eventBase, &errorBase) || !XRRQueryVersion(display, &major, &minor)
+			|| ((major == 1) && (minor < 2)))
+	{
+		return false;
+	}
+	// the Current variant (1.3) reuses the server's state instead of probing the outputs again
+	Window root = RootWindow(display, screenNumber);
+	XRRScreenResources* resources = ((major > 1) || (minor >= 3)) ? XRRGetScreenResourcesCurrent(display, root)
+			: XRRGetScreenResources(display, root);
+	if (resources == NULL)
+	{
+		return false;
+	}
+	for (int crtc = 0; crtc < resources->ncrtc; crtc++)
+	{
+		int size = XRRGetCrtcGammaSize(display, resources->crtcs[crtc]);
+		if (size > 1)
+		{
+			crtcs.push_back(resources->crtcs[crtc]);
+			crtcRamps.push_back(XRRAllocGamma(size));
+		}
+	}
+	XRRFreeScreenResources(resources);
+	return !crtcs.empty();
+}
+
+bool GammaRamp::openVidMode()
+{
+	int eventBase, errorBase;
+	if (!XF86VidModeQueryExtension(display, &eventBase, &errorBase) || !XF86VidModeGetGammaRampSize(display,
+			screenNumber, &vidModeRampSize) || (vidModeRampSize <= 1))
+	{
+		vidModeRampSize = 0;
+		return false;
+	}
+	vidModeRamp.resize(vidModeRampSize * 3);
+	return true;
+}
+
+/*
+ * Sets every CRTC to the ramp it already has and waits for the outcome,
+ * so a driver that lists gamma ramps but rejects them is found before
+ * any real change is made.
+ */
+bool GammaRamp::probeXRandR()
+{
+	for (size_t crtc = 0; crtc < crtcs.size(); crtc++)
+	{
+		XRRCrtcGamma* current = XRRGetCrtcGamma(display, crtcs[crtc]);
+		if (current == NULL)
+		{
+			return false;
+		}
+		XRRSetCrtcGamma(display, crtcs[crtc], current);
+		XRRFreeGamma(current);
+	}
+	XSync(display, False);
+	return !newErrors();
+}
+
+// The same for the XF86VidMode ramp.
+bool GammaRamp::probeVidMode()
+{
+	unsigned short* red = &vidModeRamp[0];
+	unsigned short* green = red + vidModeRampSize;
+	unsigned short* blue = green + vidModeRampSize;
+	if (!XF86VidModeGetGammaRamp(display, screenNumber, vidModeRampSize, red, green, blue)
+			|| !XF86VidModeSetGammaRamp(display, screenNumber, vidModeRampSize, red, green, blue))
+	{
+		return false;
+	}
+	XSync(display, False);
+	return !newErrors();
+}
+
+/*
+ * Whether the server has reported an error on this connection since the
+ * last call.
+ */
+bool GammaRamp::newErrors()
+{
+	int count = trappedErrors(display);
+	bool failed = (count != errorsSeen);
+	errorsSeen = count;
+	return failed;
+}
+
+/*
+ * Drops the current backend after the server rejected its ramps: XRandR
+ * gives way to XF86VidMode if that probes cleanly, anything else to
+ * xgamma. The next apply sends the full ramps again.
+ */
+void GammaRamp::fallBack()
+{
+	if (backend == BACKEND_XRANDR)
+	{
+		releaseXRandR();
+		if (openVidMode() && probeVidMode())
+		{
+			backend = BACKEND_VIDMODE;
+			rampsSent = false;
+			return;
+		}
+	}
+	close();
+}
+
+/*
+ * Sets the gamma for each channel, on the same scale as xgamma (1.0 is
+ * unchanged, higher is brighter). Only queues the request; it reaches
+ * the server with the next flush, which happens here, without waiting
+ * for a reply. Nothing is sent when the ramps come out the same as the
+ * ones already set, which is common for small slider moves.
+ */
+GammaRamp::ApplyResult GammaRamp::apply(double redGamma, double greenGamma, double blueGamma)
+{
+	// errors from earlier ramps only arrive now, as nothing waits for them
+	if ((display != NULL) && newErrors())
+	{
+		fallBack();
+	}
+	if (backend == BACKEND_XRANDR)
+	{
+		bool sent = false;
+		for (size_t crtc = 0; crtc < crtcs.size(); crtc++)
+		{
+			XRRCrtcGamma* ramp = crtcRamps[crtc];
+			if (refillRamp(ramp->red, ramp->green, ramp->blue, ramp->size, redGamma, greenGamma, blueGamma))
+			{
+				XRRSetCrtcGamma(display, crtcs[crtc], ramp);
+				sent = true;
+			}
+		}
+		rampsSent = true;
+		if (!sent)
+		{
+			return APPLY_UNCHANGED;
+		}
+		XFlush(display);
+		return APPLY_SENT;
+	}
+	if (backend == BACKEND_VIDMODE)
+	{
+		unsigned short* red = &vidModeRamp[0];
+		unsigned short* green = red + vidModeRampSize;
+		unsigned short* blue = green + vidModeRampSize;
+		if (!refillRamp(red, green, blue, vidModeRampSize, redGamma, greenGamma, blueGamma))
+		{
+			return APPLY_UNCHANGED;
+		}
+		bool applied = XF86VidModeSetGammaRamp(display, screenNumber, vidModeRampSize, red, green, blue);
+		rampsSent = applied;
+		XFlush(display);
+		return applied ? APPLY_SENT : APPLY_FAILED;
+	}
+	return applyXgamma(redGamma, greenGamma, blueGamma);
+}
+
+/*
+ * Waits until the server has dealt with every ramp sent so far, and
+ * moves on to the next backend if it rejected any of them.
+ */
+void GammaRamp::sync()
+{
+	if (display != NULL)
+	{
+		XSync(display, False);
+		if (newErrors())
+		{
+			fallBack();
+		}
+	}
+}
+
+GammaRamp::Backend GammaRamp::getBackend()
+{
+	return backend;
+}
+
+const char* GammaRamp::getBackendName()
+{
+	switch (backend)
+	{
+		case BACKEND_XRANDR:
+			return "XRandR";
+		case BACKEND_VIDMODE:
+			return "XF86VidMode";
+		default:
+			return "xgamma";
+	}
+}
+
+/*
+ * The old way: a shell, an exec and a fresh X connection every time.
+ */
+GammaRamp::ApplyResult GammaRamp::applyXgamma(double redGamma, double greenGamma, double blueGamma)
+{
+	if (rampsSent && (xgammaSent[0] == redGamma) && (xgammaSent[1] == greenGamma) && (xgammaSent[2] == blueGamma))
+	{
+		return APPLY_UNCHANGED;
+	}
+	char command[128];
+	snprintf(command, sizeof(command), "xgamma -rgamma %f -ggamma %f -bgamma %f -quiet", redGamma, greenGamma,
+			blueGamma);
+	if (system(command) != 0)
+	{
+		rampsSent = false;
+		return APPLY_FAILED;
+	}
+	xgammaSent[0] = redGamma;
+	xgammaSent[1] = greenGamma;
+	xgammaSent[2] = blueGamma;
+	rampsSent = true;
+	return APPLY_SENT;
+}
+
+/*
+ * Takes the ramps for these gammas from 'curves' and copies each channel
+ * over the ramp last sent only if it differs. Returns false when all
+ * three were unchanged.
+ */
+bool GammaRamp::refillRamp(unsigned short* red, unsigned short* green, unsigned short* blue, int size,
+		double redGamma, double greenGamma, double blueGamma)
+{
+	unsigned short* channels[3] = { red, green, blue };
+	const unsigned short* fresh = curves.getRamps(size, redGamma, greenGamma, blueGamma);
+	bool changed = false;
+	for (int channel = 0; channel < 3; channel++)
+	{
+		const unsigned short* source = fresh + channel * size;
+		if (!rampsSent || (memcmp(channels[channel], source, size * sizeof(unsigned short)) != 0))
+		{
+			memcpy(channels[channel], source, size * sizeof(unsigned short));
+			changed = true;
+		}
+	}
+	return changed;
+}
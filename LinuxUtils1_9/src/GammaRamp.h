@@ -0,0 +1,67 @@
+#ifndef GAMMARAMP_H_
+#define GAMMARAMP_H_
+
+#include <vector>
+#include <stddef.h>
+#include "GammaCurve.h"
+
+struct _XDisplay;
+struct _XRRCrtcGamma;
+
+/*
+ * Sets the display gamma in-process over one X connection that stays
+ * open, instead of running xgamma for every change. Uses XRandR 1.2 CRTC
+ * gamma ramps when the server has them, the XF86VidMode ramp otherwise,
+ * and falls back to running xgamma when neither is available (or there
+ * is no X display).
+ *
+ * X errors on its connection are trapped rather than left to the default
+ * handler, which would end the process: a backend that raises one while
+ * being probed is skipped, and one that raises one later is dropped for
+ * the next.
+ */
+class GammaRamp
+{
+	public:
+		enum Backend
+		{
+			BACKEND_XRANDR, BACKEND_VIDMODE, BACKEND_XGAMMA
+		};
+		enum ApplyResult
+		{
+			APPLY_FAILED, APPLY_SENT, APPLY_UNCHANGED
+		};
+		GammaRamp();
+		virtual ~GammaRamp();
+		bool open(Backend preferred = BACKEND_XRANDR);
+		void close();
+		ApplyResult apply(double redGamma, double greenGamma, double blueGamma);
+		void sync();
+		Backend getBackend();
+		const char* getBackendName();
+		static void initThreads(); // before any X connection, SDL's included
+	private:
+		struct _XDisplay* display;
+		Backend backend;
+		int screenNumber;
+		std::vector<unsigned long> crtcs; // XRandR CRTCs with a gamma ramp
+		std::vector<struct _XRRCrtcGamma*> crtcRamps; // one per CRTC, allocated once and refilled
+		int vidModeRampSize;
+		std::vector<unsigned short> vidModeRamp; // red, green then blue
+		GammaCurve curves; // recently built ramps
+		bool rampsSent; // false until the first apply since open
+		double xgammaSent[3];
+		int errorsSeen; // trapped errors already acted on
+		bool openXRandR();
+		bool openVidMode();
+		bool probeXRandR();
+		bool probeVidMode();
+		void releaseXRandR();
+		bool newErrors();
+		void fallBack();
+		ApplyResult applyXgamma(double redGamma, double greenGamma, double blueGamma);
+		bool refillRamp(unsigned short* red, unsigned short* green, unsigned short* blue, int size, double redGamma,
+				double greenGamma, double blueGamma);
+};
+
+#endif /* GAMMARAMP_H_ */
@@ -0,0 +1,124 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "GammaTransition.h"
+
+GammaTransition::GammaTransition(double maxGamma, unsigned int refreshInterval)
+{
+	this->maxGamma = maxGamma;
+	this->refreshInterval = refreshInterval;
+	active = false;
+	startTime = 0;
+	duration = 0;
+	lastFrame = 0;
+}
+
+GammaTransition::~GammaTransition()
+{
+}
+
+/*
+ * Begins a move from 'from' to 'to' (red, green, blue, alpha) lasting
+ * 'duration' milliseconds from 'now'. Replaces any move under way, so
+ * pass the values currently shown as 'from'.
+ */
+void GammaTransition::start(const float* from, const float* to, unsigned int now, unsigned int duration)
+{
+	for (int slider = 0; slider < 4; slider++)
+	{
+		this->from[slider] = from[slider];
+		this->to[slider] = to[slider];
+	}
+	for (int channel = 0; channel < 3; channel++)
+	{
+		fromInverse[channel] = toInverseGamma(from[channel], from[3]);
+		toInverse[channel] = toInverseGamma(to[channel], to[3]);
+	}
+	this->duration = duration;
+	startTime = now;
+	lastFrame = now;
+	active = true;
+}
+
+/*
+ * Stops where it is, for when the user takes hold of a slider.
+ */
+void GammaTransition::cancel()
+{
+	active = false;
+}
+
+bool GammaTransition::isActive()
+{
+	return active;
+}
+
+/*
+ * Fills 'values' and returns true if a refresh interval has passed since
+ * the last values handed out; otherwise leaves them alone. The final
+ * call returns the target exactly and ends the transition. Times are
+ * milliseconds, as from SDL_GetTicks, and may wrap.
+ */
+bool GammaTransition::advance(unsigned int now, float* values)
+{
+	if (!active || ((now - lastFrame) < refreshInterval))
+	{
+		return false;
+	}
+	lastFrame = now;
+	unsigned int elapsed = now - startTime;
+	if (elapsed >= duration)
+	{
+		for (int slider = 0; slider < 4; slider++)
+		{
+			values[slider] = to[slider];
+		}
+		active = false;
+		return true;
+	}
+	// smoothstep: starts and stops gently
+	float progress = (float) elapsed / duration;
+	progress = progress * progress * (3 - 2 * progress);
+	values[3] = from[3] + (to[3] - from[3]) * progress;
+	for (int channel = 0; channel < 3; channel++)
+	{
+		if (values[3] < 1)
+		{
+			// alpha near 0 flattens every channel, so there is no gamma to follow
+			values[channel] = from[channel] + (to[channel] - from[channel]) * progress;
+		}
+		else
+		{
+			values[channel] = toChannel(fromInverse[channel] + (toInverse[channel] - fromInverse[channel])
+					* progress, values[3]);
+		}
+	}
+	return true;
+}
+
+/*
+ * The slider to gamma mapping used when applying: channel scaled by
+ * alpha, then mapped onto 0.1 > maxGamma.
+ */
+double GammaTransition::toInverseGamma(float channel, float alpha)
+{
+	return 1.0 / (0.1 + (channel * (alpha / 100) * ((maxGamma - 0.1) / 100)));
+}
+
+float GammaTransition::toChannel(double inverseGamma, float alpha)
+{
+	float channel = (1.0 / inverseGamma - 0.1) / ((maxGamma - 0.1) / 100) / (alpha / 100);
+	return (channel < 0) ? 0 : ((channel > 100) ? 100 : channel);
+}
@@ -0,0 +1,39 @@
+#ifndef GAMMATRANSITION_H_
+#define GAMMATRANSITION_H_
+
+/*
+ * Moves the four gamma sliders (red, green, blue and the alpha that
+ * scales them, all 0 - 100) to new values over a fixed time, without
+ * blocking. The caller advances it once per frame; it hands back new
+ * values at most once per refresh interval, eased in and out.
+ *
+ * Each channel is interpolated in 1 / gamma rather than slider position:
+ * the log of the displayed brightness is proportional to 1 / gamma at
+ * every grey level, so equal steps there look like equal steps on
+ * screen, whereas equal slider steps change the dark end fastest.
+ */
+class GammaTransition
+{
+	public:
+		GammaTransition(double maxGamma, unsigned int refreshInterval);
+		virtual ~GammaTransition();
+		void start(const float* from, const float* to, unsigned int now, unsigned int duration);
+		void cancel();
+		bool isActive();
+		bool advance(unsigned int now, float* values);
+	private:
+		double toInverseGamma(float channel, float alpha);
+		float toChannel(double inverseGamma, float alpha);
+		double maxGamma;
+		unsigned int refreshInterval; // milliseconds between two sets of values
+		bool active;
+		unsigned int startTime;
+		unsigned int duration;
+		unsigned int lastFrame;
+		float from[4];
+		float to[4];
+		double fromInverse[3];
+		double toInverse[3];
+};
+
+#endif /* GAMMATRANSITION_H_ */
@@ -0,0 +1,790 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "HTTPClient.h"
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <spawn.h>
+
+HTTPClient::HTTPClient()
+{
+	socketHandle = -1;
+	connectTimeout = 5000;
+	readTimeout = 10000;
+	totalTimeout = 60000;
+	deadline = 0;
+	bodyDecoder = new ContentDecoder();
+	bodyListener = NULL;
+}
+
+HTTPClient::~HTTPClient()
+{
+	disconnect();
+	delete bodyDecoder;
+}
+
+/*
+ * 'readMilliseconds' bounds each wait for more data; 'totalMilliseconds'
+ * bounds the whole get(), so a server trickling bytes cannot hold it up
+ * for longer than that.
+ */
+void HTTPClient::setTimeouts(int connectMilliseconds, int readMilliseconds, int totalMilliseconds)
+{
+	connectTimeout = connectMilliseconds;
+	readTimeout = readMilliseconds;
+	totalTimeout = totalMilliseconds;
+}
+
+/*
+ * Adds a header to every following request, or replaces its value.
+ */
+void HTTPClient::setRequestHeader(const std::string& name, const std::string& value)
+{
+	requestHeaders[name] = value;
+}
+
+void HTTPClient::clearRequestHeaders()
+{
+	requestHeaders.clear();
+}
+
+void HTTPClient::setBodyListener(HTTPBodyListener* listener)
+{
+	bodyListener = listener;
+}
+
+/*
+ * Where the time went in the last get(), summed over any redirects.
+ * Resolve and connect are zero when a kept-alive connection was reused.
+ */
+HTTPClient::Timing HTTPClient::getLastTiming()
+{
+	return lastTiming;
+}
+
+double HTTPClient::monotonicMilliseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/*
+ * 'limit', cut down to what is left before the get() deadline; 0 once
+ * it has passed.
+ */
+int HTTPClient::timeLeft(int limit)
+{
+	double left = deadline - monotonicMilliseconds();
+	if (left <= 0)
+	{
+		return 0;
+	}
+	return (left < limit) ? (int) left + 1 : limit;
+}
+
+void HTTPClient::disconnect()
+{
+	if (socketHandle != -1)
+	{
+		close(socketHandle);
+		socketHandle = -1;
+	}
+	connectedHost.clear();
+	connectedPort.clear();
+	readBuffer.clear();
+}
+
+/*
+ * Fetches 'url', following up to five redirects. Returns false if no
+ * response could be read; any HTTP status, including errors, counts as
+ * a response and is left in 'response.status' for the caller to check.
+ */
+bool HTTPClient::get(const std::string& url, Response& response)
+{
+	lastTiming.resolve = 0;
+	lastTiming.connect = 0;
+	lastTiming.transfer = 0;
+	deadline = monotonicMilliseconds() + totalTimeout;
+	std::string target = url;
+	for (int redirects = 0; redirects <= 5; redirects++)
+	{
+		if (target.compare(0, 8, "https://") == 0)
+		{
+			double started = monotonicMilliseconds();
+			bool fetched = getWithWget(target, response);
+			lastTiming.transfer += monotonicMilliseconds() - started;
+			return fetched;
+		}
+		std::string host, port, path;
+		if (!parseURL(target, host, port, path))
+		{
+			return false;
+		}
+		bool keepAlive = false;
+		bool reused = (socketHandle != -1) && (host == connectedHost) && (port == connectedPort);
+		double started = monotonicMilliseconds();
+		bool fetched = reused && request(host, port, path, response, keepAlive);
+		lastTiming.transfer += monotonicMilliseconds() - started;
+		if (!fetched)
+		{
+			// a kept-alive connection may have been closed by the server, so start afresh
+			disconnect();
+			fetched = openConnection(host, port);
+			started = monotonicMilliseconds();
+			fetched = fetched && request(host, port, path, response, keepAlive);
+			lastTiming.transfer += monotonicMilliseconds() - started;
+		}
+		if (!fetched || !keepAlive)
+		{
+			disconnect();
+		}
+		if (!fetched)
+		{
+			return false;
+		}
+		std::map<std::string, std::string>::iterator location = response.headers.find("location");
+		if ((response.status < 300) || (response.status > 399) || (response.status == 304) || (location
+				== response.headers.end()))
+		{
+			return true;
+		}
+		target = resolveLocation(location->second, host, port, path);
+	}
+	return false;
+}
+
+/*
+ * Turns a Location header into an absolute URL: absolute ones are kept,
+ * "//host/..." takes this scheme, "/..." this host, and anything else is
+ * relative to the directory of the request path.
+ */
+std::string HTTPClient::resolveLocation(const std::string& location, const std::string& host,
+		const std::string& port, const std::string& path)
+{
+	if ((location.compare(0, 7, "http://") == 0) || (location.compare(0, 8, "https://") == 0))
+	{
+		return location;
+	}
+	if (location.compare(0, 2, "//") == 0)
+	{
+		return "http:" + location;
+	}
+	std::string origin = "http://" + host + ":" + port;
+	if (location.compare(0, 1, "/") == 0)
+	{
+		return origin + location;
+	}
+	std::string directory = path.substr(0, path.find_first_of("?#"));
+	directory.erase(directory.rfind('/') + 1);
+	return origin + directory + location;
+}
+
+/*
+ * The fallback for TLS: runs wget, which has a TLS library where this
+ * client has none. The request headers (conditional GET, Accept-Encoding)
+ * go along as --header options, and the URL as an argument, never
+ * through a shell. wget follows redirects itself and reports each
+ * response's status and headers on stderr (-S); the last of them becomes
+ * this response. The body comes back on a pipe still encoded and is
+ * decoded here, so it reaches the body listener a block at a time just
+ * like a plain fetch. Costs a process per fetch, but only for https.
+ */
+bool HTTPClient::getWithWget(const std::string& url, Response& response)
+{
+	response.status = 0;
+	response.headers.clear();
+	response.body.clear();
+	int output[2], report[2];
+	if (pipe2(output, O_CLOEXEC) != 0)
+	{
+		return false;
+	}
+	if (pipe2(report, O_CLOEXEC) != 0)
+	{
+		close(output[0]);
+		close(output[1]);
+		return false;
+	}
+	std::vector<std::string> options;
+	options.push_back("wget");
+	options.push_back("--no-proxy");
+	options.push_back("-q");
+	options.push_back("-S");
+	options.push_back("--max-redirect=5");
+	options.push_back("-O");
+	options.push_back("-");
+	for (std::map<std::string, std::string>::iterator header = requestHeaders.begin(); header
+			!= requestHeaders.end(); header++)
+	{
+		std::string value = header->second;
+		value.erase(std::remove(value.begin(), value.end(), '\r'), value.end());
+		value.erase(std::remove(value.begin(), value.end(), '\n'), value.end());
+		options.push_back("--header=" + header->first + ": " + value);
+	}
+	options.push_back("--");
+	options.push_back(url);
+	std::vector<char*> arguments;
+	for (size_t option = 0; option < options.size(); option++)
+	{
+		arguments.push_back((char*) options[option].c_str());
+	}
+	arguments.push_back(NULL);
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, report[1], STDERR_FILENO);
+	pid_t child;
+	bool spawned = (posix_spawnp(&child, "wget", &actions, NULL, &arguments[0], environ) == 0);
+	posix_spawn_file_actions_destroy(&actions);
+	close(output[1]);
+	close(report[1]);
+	if (!spawned)
+	{
+		close(output[0]);
+		close(report[0]);
+		return false;
+	}
+	std::string serverResponse; // wget's -S output
+	bool bodyStarted = false;
+	bool decoded = true;
+	bool outputOpen = true, reportOpen = true;
+	char block[16384];
+	while (outputOpen || reportOpen)
+	{
+		struct pollfd waitFor[2];
+		waitFor[0].fd = reportOpen ? report[0] : -1;
+		waitFor[0].events = POLLIN;
+		waitFor[1].fd = outputOpen ? output[0] : -1;
+		waitFor[1].events = POLLIN;
+		int wait = timeLeft(readTimeout);
+		int ready = (wait > 0) ? poll(waitFor, 2, wait) : 0;
+		if ((ready < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		if (ready <= 0)
+		{
+			break; // timed out
+		}
+		// wget writes the headers before the body, so draining stderr first means they are in by then
+		bool fromReport = (waitFor[0].revents != 0);
+		ssize_t result = read(fromReport ? report[0] : output[0], block, sizeof(block));
+		if ((result < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		if (result <= 0)
+		{
+			(fromReport ? reportOpen : outputOpen) = false;
+			continue;
+		}
+		if (fromReport)
+		{
+			serverResponse.append(block, result);
+			continue;
+		}
+		if (!bodyStarted)
+		{
+			bodyStarted = true;
+			parseWgetResponse(serverResponse, response);
+			decoded = bodyDecoder->begin(response.headers["content-encoding"]);
+			if (decoded && (bodyListener != NULL))
+			{
+				bodyListener->bodyBegin(response);
+			}
+		}
+		decoded = decoded && decodeBody(block, result, response.body);
+	}
+	bool complete = !outputOpen && !reportOpen;
+	close(output[0]);
+	close(report[0]);
+	if (!complete)
+	{
+		kill(child, SIGTERM);
+	}
+	int exitStatus = 0;
+	while ((waitpid(child, &exitStatus, 0) == -1) && (errno == EINTR))
+	{
+	}
+	if (!bodyStarted)
+	{
+		parseWgetResponse(serverResponse, response);
+	}
+	else
+	{
+		decoded = decoded && bodyDecoder->finish();
+	}
+	// 8 is how wget reports an error status, which is still a response
+	bool exited = WIFEXITED(exitStatus) && ((WEXITSTATUS(exitStatus) == 0) || (WEXITSTATUS(exitStatus) == 8));
+	if (!complete || !exited || !decoded || (response.status == 0))
+	{
+		response.status = 0;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Takes the status and headers of the last response in wget's -S
+ * output: a "  HTTP/1.1 200 OK" line, then "  Name: value" lines.
+ */
+void HTTPClient::parseWgetResponse(const std::string& serverResponse, Response& response)
+{
+	response.status = 0;
+	response.headers.clear();
+	size_t statusLine = serverResponse.rfind("  HTTP/");
+	if ((statusLine == std::string::npos) || ((statusLine != 0) && (serverResponse[statusLine - 1] != '\n')))
+	{
+		return;
+	}
+	size_t lineEnd = serverResponse.find('\n', statusLine);
+	std::string line = serverResponse.substr(statusLine + 2, lineEnd - statusLine - 2);
+	size_t space = line.find(' ');
+	if (space != std::string::npos)
+	{
+		response.status = atoi(line.c_str() + space + 1);
+	}
+	while ((lineEnd != std::string::npos) && (serverResponse.compare(lineEnd + 1, 2, "  ") == 0))
+	{
+		size_t lineStart = lineEnd + 3;
+		lineEnd = serverResponse.find('\n', lineStart);
+		line = serverResponse.substr(lineStart, (lineEnd == std::string::npos) ? std::string::npos : lineEnd
+				- lineStart);
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			continue;
+		}
+		std::string name = line.substr(0, colon);
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		response.headers[name] = (valueStart != std::string::npos) ? line.substr(valueStart) : "";
+	}
+}
+
+/*
+ * Splits "http://host[:port][/path]". Other schemes are not supported.
+ */
+bool HTTPClient::parseURL(const std::string& url, std::string& host, std::string& port, std::string& path)
+{
+	const std::string scheme = "http://";
+	if (url.compare(0, scheme.length(), scheme) != 0)
+	{
+		return false;
+	}
+	size_t hostStart = scheme.length();
+	size_t pathStart = url.find('/', hostStart);
+	if (pathStart == std::string::npos)
+	{
+		pathStart = url.length();
+	}
+	host = url.substr(hostStart, pathStart - hostStart);
+	path = (pathStart < url.length()) ? url.substr(pathStart) : "/";
+	port = "80";
+	size_t colon = host.find(':');
+	if (colon != std::string::npos)
+	{
+		port = host.substr(colon + 1);
+		host = host.substr(0, colon);
+	}
+	return (host.length() != 0) && (port.length() != 0);
+}
+
+/*
+ * An asynchronous lookup and what it points to, kept together so that a
+ * lookup which cannot be cancelled can be left to finish on its own.
+ */
+struct ADDRESS_LOOKUP
+{
+		struct gaicb request;
+		struct addrinfo hints;
+		std::string host;
+		std::string port;
+};
+
+/*
+ * getaddrinfo, but bounded by the connect timeout and the get() deadline:
+ * the lookup runs on glibc's resolver thread (getaddrinfo_a) and is
+ * cancelled if it takes too long. A lookup already too far along to
+ * cancel still writes to its request when it ends, so that one request
+ * is leaked rather than freed under it.
+ */
+bool HTTPClient::resolve(const std::string& host, const std::string& port, struct addrinfo** addresses)
+{
+	ADDRESS_LOOKUP* lookup = new ADDRESS_LOOKUP();
+	lookup->host = host;
+	lookup->port = port;
+	memset(&lookup->hints, 0, sizeof(lookup->hints));
+	lookup->hints.ai_family = AF_UNSPEC;
+	lookup->hints.ai_socktype = SOCK_STREAM;
+	memset(&lookup->request, 0, sizeof(lookup->request));
+	lookup->request.ar_name = lookup->host.c_str();
+	lookup->request.ar_service = lookup->port.c_str();
+	lookup->request.ar_request = &lookup->hints;
+	struct gaicb* requests[1] = { &lookup->request };
+	if (getaddrinfo_a(GAI_NOWAIT, requests, 1, NULL) != 0)
+	{
+		delete lookup;
+		return false;
+	}
+	int status;
+	while ((status = gai_error(&lookup->request)) == EAI_INPROGRESS)
+	{
+		int wait = timeLeft(connectTimeout);
+		if (wait == 0)
+		{
+			break;
+		}
+		struct timespec timeout;
+		timeout.tv_sec = wait / 1000;
+		timeout.tv_nsec = (long) (wait % 1000) * 1000000;
+		const struct gaicb* pending[1] = { &lookup->request };
+		gai_suspend(pending, 1, &timeout);
+	}
+	if (status == EAI_INPROGRESS)
+	{
+		if (gai_cancel(&lookup->request) == EAI_NOTCANCELED)
+		{
+			return false; // 'lookup' now belongs to the resolver thread
+		}
+		status = gai_error(&lookup->request); // cancelled, or finished just now
+	}
+	*addresses = (status == 0) ? lookup->request.ar_result : NULL;
+	delete lookup;
+	return (status == 0);
+}
+
+/*
+ * Connects to the first address for 'host' that answers within the
+ * connect timeout.
+ */
+bool HTTPClient::openConnection(const std::string& host, const std::string& port)
+{
+	struct addrinfo* addresses = NULL;
+	double started = monotonicMilliseconds();
+	bool resolved = resolve(host, port, &addresses);
+	lastTiming.resolve += monotonicMilliseconds() - started;
+	if (!resolved)
+	{
+		return false;
+	}
+	started = monotonicMilliseconds();
+	for (struct addrinfo* address = addresses; (address != NULL) && (socketHandle == -1); address
+			= address->ai_next)
+	{
+		// close-on-exec, so a child such as xgamma or wget does not inherit the connection
+		int handle = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+				address->ai_protocol);
+		if (handle == -1)
+		{
+			continue;
+		}
+		bool connected = (connect(handle, address->ai_addr, address->ai_addrlen) == 0);
+		if ((!connected) && (errno == EINPROGRESS))
+		{
+			struct pollfd waitFor;
+			waitFor.fd = handle;
+			waitFor.events = POLLOUT;
+			int error = 0;
+			socklen_t errorLength = sizeof(error);
+			int wait = timeLeft(connectTimeout);
+			connected = (wait > 0) && (poll(&waitFor, 1, wait) == 1) && (getsockopt(handle, SOL_SOCKET, SO_ERROR,
+					&error, &errorLength) == 0) && (error == 0);
+		}
+		if (connected)
+		{
+			socketHandle = handle;
+		}
+		else
+		{
+			close(handle);
+		}
+	}
+	freeaddrinfo(addresses);
+	lastTiming.connect += monotonicMilliseconds() - started;
+	if (socketHandle == -1)
+	{
+		return false;
+	}
+	connectedHost = host;
+	connectedPort = port;
+	readBuffer.clear();
+	return true;
+}
+
+/*
+ * Sends a GET over the open connection and reads the whole response.
+ * 'keepAlive' is set if the connection can carry another request.
+ */
+bool HTTPClient::request(const std::string& host, const std::string& port, const std::string& path,
+		Response& response, bool& keepAlive)
+{
+	std::string requestText = "GET " + path + " HTTP/1.1\r\nHost: " + host;
+	if (port != "80")
+	{
+		requestText += ":" + port;
+	}
+	requestText += "\r\nConnection: keep-alive\r\n";
+	for (std::map<std::string, std::string>::iterator header = requestHeaders.begin(); header
+			!= requestHeaders.end(); header++)
+	{
+		requestText += header->first + ": " + header->second + "\r\n";
+	}
+	requestText += "\r\n";
+	if (!sendAll(requestText))
+	{
+		return false;
+	}
+	response.status = 0;
+	response.headers.clear();
+	response.body.clear();
+	std::string line;
+	if (!readLine(line) || (line.compare(0, 5, "HTTP/") != 0))
+	{
+		return false;
+	}
+	size_t space = line.find(' ');
+	if (space != std::string::npos)
+	{
+		response.status = atoi(line.c_str() + space + 1);
+	}
+	keepAlive = (line.compare(0, 8, "HTTP/1.0") != 0);
+	while (readLine(line) && (line.length() != 0))
+	{
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			continue;
+		}
+		std::string name = line.substr(0, colon);
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		response.headers[name] = (valueStart != std::string::npos) ? line.substr(valueStart) : "";
+	}
+	if (line.length() != 0)
+	{
+		return false; // connection dropped inside the headers
+	}
+	std::string connection = response.headers["connection"];
+	std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+	if (connection == "close")
+	{
+		keepAlive = false;
+	}
+	else if (connection == "keep-alive")
+	{
+		keepAlive = true;
+	}
+	if ((response.status == 204) || (response.status == 304) || ((response.status >= 100) && (response.status
+			< 200)))
+	{
+		return true; // no body
+	}
+	if (!bodyDecoder->begin(response.headers["content-encoding"]))
+	{
+		keepAlive = false;
+		return false; // not an encoding we can read
+	}
+	if (bodyListener != NULL)
+	{
+		bodyListener->bodyBegin(response);
+	}
+	std::string encoding = response.headers["transfer-encoding"];
+	std::transform(encoding.begin(), encoding.end(), encoding.begin(), ::tolower);
+	if (encoding.find("chunked") != std::string::npos)
+	{
+		while (true)
+		{
+			if (!readLine(line))
+			{
+				return false;
+			}
+			size_t chunkSize = strtoul(line.c_str(), NULL, 16);
+			if (chunkSize == 0)
+			{
+				// skip any trailers
+				while (readLine(line) && (line.length() != 0))
+				{
+				}
+				return bodyDecoder->finish();
+			}
+			if (!readBody(chunkSize, response.body) || !readLine(line))
+			{
+				return false;
+			}
+		}
+	}
+	if (response.headers.find("content-length") != response.headers.end())
+	{
+		size_t length = strtoul(response.headers["content-length"].c_str(), NULL, 10);
+		return readBody(length, response.body) && bodyDecoder->finish();
+	}
+	// no length given, so the body runs until the server closes
+	keepAlive = false;
+	do
+	{
+		if (!decodeBody(readBuffer.data(), readBuffer.length(), response.body))
+		{
+			return false;
+		}
+		readBuffer.clear();
+	}
+	while (fill());
+	return bodyDecoder->finish();
+}
+
+bool HTTPClient::sendAll(const std::string& data)
+{
+	size_t sent = 0;
+	while (sent < data.length())
+	{
+		ssize_t result = send(socketHandle, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+		if (result > 0)
+		{
+			sent += result;
+			continue;
+		}
+		if ((result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+		{
+			struct pollfd waitFor;
+			waitFor.fd = socketHandle;
+			waitFor.events = POLLOUT;
+			int wait = timeLeft(readTimeout);
+			if ((wait > 0) && (poll(&waitFor, 1, wait) == 1))
+			{
+				continue;
+			}
+		}
+		else if ((result < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Waits up to the read timeout, or whatever is left before the deadline,
+ * for more data and appends it to readBuffer. Returns false on timeout,
+ * error or end of stream.
+ */
+bool HTTPClient::fill()
+{
+	char block[16384];
+	while (true)
+	{
+		ssize_t result = recv(socketHandle, block, sizeof(block), 0);
+		if (result > 0)
+		{
+			readBuffer.append(block, result);
+			return true;
+		}
+		if (result == 0)
+		{
+			return false;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+		{
+			return false;
+		}
+		struct pollfd waitFor;
+		waitFor.fd = socketHandle;
+		waitFor.events = POLLIN;
+		int wait = timeLeft(readTimeout);
+		if ((wait == 0) || (poll(&waitFor, 1, wait) != 1))
+		{
+			return false;
+		}
+	}
+}
+
+/*
+ * Reads one CRLF terminated line, without the line ending.
+ */
+bool HTTPClient::readLine(std::string& line)
+{
+	size_t end;
+	while ((end = readBuffer.find("\r\n")) == std::string::npos)
+	{
+		if (!fill())
+		{
+			line.clear();
+			return false;
+		}
+	}
+	line.assign(readBuffer, 0, end);
+	readBuffer.erase(0, end + 2);
+	return true;
+}
+
+/*
+ * Passes the next 'count' bytes of the stream through the body decoder
+ * onto the end of 'body', a received block at a time.
+ */
+bool HTTPClient::readBody(size_t count, std::string& body)
+{
+	while (count > 0)
+	{
+		if (readBuffer.empty() && !fill())
+		{
+			return false;
+		}
+		size_t take = std::min(count, readBuffer.length());
+		if (!decodeBody(readBuffer.data(), take, body))
+		{
+			return false;
+		}
+		readBuffer.erase(0, take);
+		count -= take;
+	}
+	return true;
+}
+
+/*
+ * Decodes onto the end of 'body' and shows the listener what was added.
+ */
+bool HTTPClient::decodeBody(const char* data, size_t length, std::string& body)
+{
+	size_t decodedFrom = body.length();
+	if (!bodyDecoder->decode(data, length, body))
+	{
+		return false;
+	}
+	if ((bodyListener != NULL) && (body.length() > decodedFrom))
+	{
+		bodyListener->bodyData(body.data() + decodedFrom, body.length() - decodedFrom);
+	}
+	return true;
+}
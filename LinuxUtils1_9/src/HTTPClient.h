@@ -0,0 +1,90 @@
+#ifndef HTTPCLIENT_H_
+#define HTTPCLIENT_H_
+
+#include <string>
+#include <map>
+#include "ContentDecoder.h"
+
+class HTTPBodyListener;
+
+/*
+ * Minimal HTTP/1.1 client for plain "http://" URLs; "https://" ones,
+ * including redirects to them, are fetched by running wget, as the
+ * weather feed used to be, with the same headers sent and the real status
+ * and headers reported. The body is
+ * read straight into memory, and a gzip or deflate Content-Encoding is
+ * undone as the bytes arrive; a body listener sees each decoded block as
+ * soon as it is ready. The connection is kept open after a
+ * request and reused by the next one to the same host and port.
+ */
+class HTTPClient
+{
+	public:
+		struct Response
+		{
+				int status;
+				std::map<std::string, std::string> headers; // names in lower case
+				std::string body; // already decoded
+		};
+		struct Timing
+		{
+				double resolve; // milliseconds in DNS lookup
+				double connect; // milliseconds establishing the connection
+				double transfer; // milliseconds from sending the request to the end of the body
+		};
+		HTTPClient();
+		virtual ~HTTPClient();
+		void setTimeouts(int connectMilliseconds, int readMilliseconds, int totalMilliseconds);
+		void setRequestHeader(const std::string& name, const std::string& value);
+		void clearRequestHeaders();
+		void setBodyListener(HTTPBodyListener* listener);
+		bool get(const std::string& url, Response& response);
+		Timing getLastTiming();
+		void disconnect();
+	private:
+		int socketHandle;
+		std::string connectedHost;
+		std::string connectedPort;
+		int connectTimeout; // milliseconds
+		int readTimeout; // milliseconds
+		int totalTimeout; // milliseconds for a whole get(), redirects included
+		double deadline; // monotonic milliseconds when the current get() gives up
+		std::string readBuffer; // received but not yet consumed
+		std::map<std::string, std::string> requestHeaders; // sent with every request
+		Timing lastTiming;
+		ContentDecoder* bodyDecoder;
+		HTTPBodyListener* bodyListener;
+		double monotonicMilliseconds();
+		int timeLeft(int limit);
+		std::string resolveLocation(const std::string& location, const std::string& host, const std::string& port,
+				const std::string& path);
+		bool getWithWget(const std::string& url, Response& response);
+		void parseWgetResponse(const std::string& serverResponse, Response& response);
+		bool resolve(const std::string& host, const std::string& port, struct addrinfo** addresses);
+		bool parseURL(const std::string& url, std::string& host, std::string& port, std::string& path);
+		bool openConnection(const std::string& host, const std::string& port);
+		bool request(const std::string& host, const std::string& port, const std::string& path, Response& response,
+				bool& keepAlive);
+		bool sendAll(const std::string& data);
+		bool fill();
+		bool readLine(std::string& line);
+		bool readBody(size_t count, std::string& body);
+		bool decodeBody(const char* data, size_t length, std::string& body);
+};
+
+/*
+ * Sees the decoded body of every response while it is still arriving;
+ * HTTPClient collects it into Response::body all the same. bodyBegin()
+ * comes once the headers are read, for redirects and errors too.
+ */
+class HTTPBodyListener
+{
+	public:
+		virtual ~HTTPBodyListener()
+		{
+		}
+		virtual void bodyBegin(const HTTPClient::Response& response) = 0;
+		virtual void bodyData(const char* data, size_t length) = 0;
+};
+
+#endif /* HTTPCLIENT_H_ */
@@ -0,0 +1,373 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JSONForecastDecoder.h"
+#include "JSONScanner.h"
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const size_t JSONForecastDecoder::NONE;
+
+JSONForecastDecoder::JSONForecastDecoder()
+{
+	text = NULL;
+}
+
+JSONForecastDecoder::~JSONForecastDecoder()
+{
+}
+
+bool JSONForecastDecoder::accepts(const std::string& contentType, const char* data, size_t length)
+{
+	if (contentType.find("json") != std::string::npos)
+	{
+		return true;
+	}
+	return firstSignificant(data, length) == '{';
+}
+
+bool JSONForecastDecoder::decode(const char* data, size_t length, FORECAST* day)
+{
+	text = data;
+	if (!JSONScanner::buildIndex(data, length, tokens, partners) || tokens.empty() || (data[tokens[0]] != '{'))
+	{
+		return false;
+	}
+	size_t daily = containerAfter(findMember(0, "daily"), '{');
+	if (daily == NONE)
+	{
+		return false;
+	}
+	size_t units = containerAfter(findMember(0, "daily_units"), '{');
+	XMLSpan dates[3], codes[3], maxima[3], minima[3], speeds[3], directions[3];
+	if (readColumn(daily, "time", NULL, dates) < 3)
+	{
+		return false;
+	}
+	readColumn(daily, "weather_code", "weathercode", codes);
+	readColumn(daily, "temperature_2m_max", NULL, maxima);
+	readColumn(daily, "temperature_2m_min", NULL, minima);
+	readColumn(daily, "wind_speed_10m_max", "windspeed_10m_max", speeds);
+	readColumn(daily, "wind_direction_10m_dominant", "winddirection_10m_dominant", directions);
+
+	bool fahrenheit = (readUnit(units, "temperature_2m_max", NULL).find("F") != XMLSpan::npos);
+	XMLSpan speedUnit = readUnit(units, "wind_speed_10m_max", "windspeed_10m_max");
+	double toMph = 1 / 1.609344; // Open-Meteo defaults to km/h
+	if (speedUnit == XMLSpan("mph"))
+	{
+		toMph = 1;
+	}
+	else if (speedUnit == XMLSpan("m/s"))
+	{
+		toMph = 2.236936;
+	}
+	else if (speedUnit == XMLSpan("kn"))
+	{
+		toMph = 1.150779;
+	}
+
+	for (int thisDay = 0; thisDay < 3; thisDay++)
+	{
+		FORECAST& forecast = day[thisDay];
+		forecast.day = weekday(dates[thisDay]);
+		int code = -1;
+		spanToInt(codes[thisDay], code);
+		forecast.description = weatherText(code);
+		double minimum = 0, maximum = 0;
+		spanToDouble(minima[thisDay], minimum);
+		if (!spanToDouble(maxima[thisDay], maximum))
+		{
+			maximum = minimum; // No max found!
+		}
+		if (fahrenheit)
+		{
+			minimum = (minimum - 32) * 5 / 9;
+			maximum = (maximum - 32) * 5 / 9;
+		}
+		forecast.minTemp = (int) floor(minimum + 0.5);
+		forecast.maxTemp = (int) floor(maximum + 0.5);
+		double direction = 0;
+		forecast.windDirection = spanToDouble(directions[thisDay], direction) ? compassPoint(direction) : "";
+		double speed = 0;
+		spanToDouble(speeds[thisDay], speed);
+		forecast.windSpeed = (int) floor(speed * toMph + 0.5);
+	}
+	return true;
+}
+
+/*
+ * The ':' token before the value of member 'name' in the object opened at
+ * token 'object', or NONE. Values of the members passed over are skipped
+ * whole.
+ */
+size_t JSONForecastDecoder::findMember(size_t object, const char* name)
+{
+	if (object == NONE)
+	{
+		return NONE;
+	}
+	XMLSpan wanted(name);
+	size_t token = object + 1;
+	while ((token + 2 < tokens.size()) && (text[tokens[token]] == '"') && (text[tokens[token + 2]] == ':'))
+	{
+		XMLSpan key(text + tokens[token] + 1, tokens[token + 1] - tokens[token] - 1);
+		if (key == wanted)
+		{
+			return token + 2;
+		}
+		token = afterValue(token + 2);
+		if ((token >= tokens.size()) || (text[tokens[token]] != ','))
+		{
+			break;
+		}
+		token++;
+	}
+	return NONE;
+}
+
+/*
+ * Index of the first token after the value that follows 'token' (a ':',
+ * ',' or '['). A number, true, false or null is not a token itself, so
+ * after one of those it is simply the next token.
+ */
+size_t JSONForecastDecoder::afterValue(size_t token)
+{
+	size_t next = token + 1;
+	if (next >= tokens.size())
+	{
+		return tokens.size();
+	}
+	char found = text[tokens[next]];
+	if ((found == '{') || (found == '['))
+	{
+		return partners[next] + 1;
+	}
+	if (found == '"')
+	{
+		return next + 2;
+	}
+	return next;
+}
+
+/*
+ * The opening token of the value after 'token' if it is an object ('{')
+ * or array ('['), as asked for by 'open'. NONE otherwise.
+ */
+size_t JSONForecastDecoder::containerAfter(size_t token, char open)
+{
+	if ((token == NONE) || (token + 1 >= tokens.size()) || (text[tokens[token + 1]] != open))
+	{
+		return NONE;
+	}
+	return token + 1;
+}
+
+/*
+ * The value after 'token': the contents of a string, the text of a number
+ * or literal, or empty for an object or array.
+ */
+XMLSpan JSONForecastDecoder::valueAfter(size_t token)
+{
+	size_t next = token + 1;
+	if ((token == NONE) || (next >= tokens.size()))
+	{
+		return XMLSpan();
+	}
+	char found = text[tokens[next]];
+	if (found == '"')
+	{
+		return XMLSpan(text + tokens[next] + 1, tokens[next + 1] - tokens[next] - 1);
+	}
+	if ((found == '{') || (found == '['))
+	{
+		return XMLSpan();
+	}
+	size_t start = tokens[token] + 1;
+	size_t end = tokens[next];
+	while ((start < end) && ((text[start] == ' ') || (text[start] == '\t') || (text[start] == '\r')
+			|| (text[start] == '\n')))
+	{
+		start++;
+	}
+	while ((end > start) && ((text[end - 1] == ' ') || (text[end - 1] == '\t') || (text[end - 1] == '\r')
+			|| (text[end - 1] == '\n')))
+	{
+		end--;
+	}
+	return XMLSpan(text + start, end - start);
+}
+
+/*
+ * The first three entries of array member 'name' (or 'oldName', as older
+ * responses call it) of the "daily" object. Returns how many were found.
+ */
+size_t JSONForecastDecoder::readColumn(size_t daily, const char* name, const char* oldName, XMLSpan* values)
+{
+	size_t array = containerAfter(findMember(daily, name), '[');
+	if ((array == NONE) && (oldName != NULL))
+	{
+		array = containerAfter(findMember(daily, oldName), '[');
+	}
+	if (array == NONE)
+	{
+		return 0;
+	}
+	size_t found = 0;
+	size_t separator = array;
+	while ((found < 3) && (separator < partners[array]))
+	{
+		XMLSpan value = valueAfter(separator);
+		if ((value.length == 0) && (separator + 1 == partners[array]))
+		{
+			break; // empty array
+		}
+		values[found++] = value;
+		separator = afterValue(separator);
+	}
+	return found;
+}
+
+XMLSpan JSONForecastDecoder::readUnit(size_t units, const char* name, const char* oldName)
+{
+	size_t member = findMember(units, name);
+	if ((member == NONE) && (oldName != NULL))
+	{
+		member = findMember(units, oldName);
+	}
+	return valueAfter(member);
+}
+
+/*
+ * Reads a JSON number. Returns false for null or anything else that is
+ * not a number, leaving 'value' untouched.
+ */
+bool JSONForecastDecoder::spanToDouble(XMLSpan text, double& value)
+{
+	char buffer[64];
+	if ((text.length == 0) || (text.length >= sizeof(buffer)))
+	{
+		return false;
+	}
+	memcpy(buffer, text.data, text.length);
+	buffer[text.length] = '\0';
+	char* end;
+	double result = strtod(buffer, &end);
+	if (end != buffer + text.length)
+	{
+		return false;
+	}
+	value = result;
+	return true;
+}
+
+/*
+ * Day of the week for an ISO "YYYY-MM-DD" date, or "" if it is not one.
+ */
+const char* JSONForecastDecoder::weekday(XMLSpan date)
+{
+	static const char* const names[] =
+	{ "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+	static const int monthOffset[] =
+	{ 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+	int year = 0, month = 0, dayOfMonth = 0;
+	if ((date.length < 10) || (date.data[4] != '-') || (date.data[7] != '-') || !spanToInt(date.substr(0, 4),
+			year) || !spanToInt(date.substr(5, 2), month) || !spanToInt(date.substr(8, 2), dayOfMonth) || (month
+			< 1) || (month > 12))
+	{
+		return "";
+	}
+	if (month < 3)
+	{
+		year--;
+	}
+	return names[(year + year / 4 - year / 100 + year / 400 + monthOffset[month - 1] + dayOfMonth) % 7];
+}
+
+/*
+ * Overview for a WMO weather interpretation code.
+ */
+const char* JSONForecastDecoder::weatherText(int code)
+{
+	switch (code)
+	{
+		case 0:
+			return "Clear Sky";
+		case 1:
+			return "Mainly Clear";
+		case 2:
+			return "Partly Cloudy";
+		case 3:
+			return "Overcast";
+		case 45:
+		case 48:
+			return "Fog";
+		case 51:
+		case 53:
+		case 55:
+			return "Drizzle";
+		case 56:
+		case 57:
+			return "Freezing Drizzle";
+		case 61:
+			return "Light Rain";
+		case 63:
+			return "Rain";
+		case 65:
+			return "Heavy Rain";
+		case 66:
+		case 67:
+			return "Freezing Rain";
+		case 71:
+			return "Light Snow";
+		case 73:
+			return "Snow";
+		case 75:
+			return "Heavy Snow";
+		case 77:
+			return "Snow Grains";
+		case 80:
+			return "Light Rain Showers";
+		case 81:
+			return "Rain Showers";
+		case 82:
+			return "Heavy Rain Showers";
+		case 85:
+			return "Light Snow Showers";
+		case 86:
+			return "Heavy Snow Showers";
+		case 95:
+			return "Thunderstorm";
+		case 96:
+		case 99:
+			return "Thunderstorm With Hail";
+		default:
+			return "";
+	}
+}
+
+/*
+ * Names the direction the wind blows from the way the RSS feed does.
+ */
+const char* JSONForecastDecoder::compassPoint(double degrees)
+{
+	static const char* const points[] =
+	{ "Northerly", "North Easterly", "Easterly", "South Easterly", "Southerly", "South Westerly", "Westerly",
+			"North Westerly" };
+	int point = (int) floor(fmod(fmod(degrees, 360) + 360 + 22.5, 360) / 45);
+	return points[point % 8];
+}
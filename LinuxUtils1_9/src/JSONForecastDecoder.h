@@ -0,0 +1,41 @@
+#ifndef JSONFORECASTDECODER_H_
+#define JSONFORECASTDECODER_H_
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "ForecastDecoder.h"
+#include "XMLSpan.h"
+
+/*
+ * Open-Meteo style daily forecasts: a "daily" object holding one array per
+ * field ("time", "weather_code", "temperature_2m_max", ...), with units in
+ * "daily_units". Reads on demand from a structural index: only the
+ * members it needs are looked at, and anything else, such as a large
+ * "hourly" block, is stepped over whole without being parsed.
+ */
+class JSONForecastDecoder: public ForecastDecoder
+{
+	public:
+		JSONForecastDecoder();
+		virtual ~JSONForecastDecoder();
+		virtual bool accepts(const std::string& contentType, const char* data, size_t length);
+		virtual bool decode(const char* data, size_t length, FORECAST* day);
+	private:
+		static const size_t NONE = (size_t) -1;
+		const char* text;
+		std::vector<size_t> tokens; // offsets of structural characters
+		std::vector<size_t> partners; // closing token of each '{' or '['
+		size_t findMember(size_t object, const char* name);
+		size_t afterValue(size_t token);
+		size_t containerAfter(size_t token, char open);
+		XMLSpan valueAfter(size_t token);
+		size_t readColumn(size_t daily, const char* name, const char* oldName, XMLSpan* values);
+		XMLSpan readUnit(size_t units, const char* name, const char* oldName);
+		static bool spanToDouble(XMLSpan text, double& value);
+		static const char* weekday(XMLSpan date);
+		static const char* weatherText(int code);
+		static const char* compassPoint(double degrees);
+};
+
+#endif /* JSONFORECASTDECODER_H_ */
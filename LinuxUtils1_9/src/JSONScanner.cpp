@@ -0,0 +1,185 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JSONScanner.h"
+#include "ScannerSupport.h"
+#include <vector>
+
+/*
+ * Fills 'tokens' with the offset of every structural character outside a
+ * string, plus the opening and closing quote of each string, in order.
+ * For a '{' or '[' token, 'partners' holds the index of the token that
+ * closes it; for any other token it holds 0. Returns false if the
+ * brackets or quotes do not balance.
+ */
+bool JSONScanner::buildIndex(const char* data, size_t length, std::vector<size_t>& tokens,
+		std::vector<size_t>& partners)
+{
+	std::vector<size_t> candidates;
+	candidates.reserve(length / 8);
+	size_t pos = 0;
+	if (cpuHasAVX2())
+	{
+		pos = findStructureAVX2(data, pos, length, candidates);
+	}
+	pos = findStructureSSE2(data, pos, length, candidates);
+	findStructureScalar(data, pos, length, candidates);
+
+	tokens.clear();
+	partners.clear();
+	tokens.reserve(candidates.size());
+	partners.reserve(candidates.size());
+	std::vector<size_t> openBrackets;
+	bool inString = false;
+	size_t escaped = (size_t) -1; // offset of the character after a backslash
+	for (size_t candidate = 0; candidate < candidates.size(); candidate++)
+	{
+		size_t offset = candidates[candidate];
+		char found = data[offset];
+		if (offset == escaped)
+		{
+			continue;
+		}
+		if (inString)
+		{
+			if (found == '\\')
+			{
+				escaped = offset + 1;
+			}
+			else if (found == '"')
+			{
+				inString = false;
+				tokens.push_back(offset);
+				partners.push_back(0);
+			}
+			continue;
+		}
+		if (found == '\\')
+		{
+			return false;
+		}
+		inString = (found == '"');
+		if ((found == '}') || (found == ']'))
+		{
+			if (openBrackets.empty() || (data[tokens[openBrackets.back()]] != ((found == '}') ? '{' : '[')))
+			{
+				return false;
+			}
+			partners[openBrackets.back()] = tokens.size();
+			openBrackets.pop_back();
+		}
+		else if ((found == '{') || (found == '['))
+		{
+			openBrackets.push_back(tokens.size());
+		}
+		tokens.push_back(offset);
+		partners.push_back(0);
+	}
+	return !inString && openBrackets.empty();
+}
+
+static inline bool isStructural(char found)
+{
+	return (found == '{') || (found == '}') || (found == '[') || (found == ']') || (found == ':') || (found
+			== ',') || (found == '"') || (found == '\\');
+}
+
+size_t JSONScanner::findStructureScalar(const char* data, size_t from, size_t length,
+		std::vector<size_t>& candidates)
+{
+	for (size_t pos = from; pos < length; pos++)
+	{
+		if (isStructural(data[pos]))
+		{
+			candidates.push_back(pos);
+		}
+	}
+	return length;
+}
+
+#ifdef SCANNER_X86
+
+/*
+ * One compare per structural character, OR-ed into a single mask. Both
+ * vector loops stop short of the last partial block and return where they
+ * got to, leaving the tail to the next narrower loop.
+ */
+size_t JSONScanner::findStructureSSE2(const char* data, size_t from, size_t length,
+		std::vector<size_t>& candidates)
+{
+	const __m128i openBrace = _mm_set1_epi8('{');
+	const __m128i closeBrace = _mm_set1_epi8('}');
+	const __m128i openBracket = _mm_set1_epi8('[');
+	const __m128i closeBracket = _mm_set1_epi8(']');
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	size_t pos = from;
+	for (; pos + 16 <= length; pos += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*) (data + pos));
+		__m128i braces = _mm_or_si128(_mm_cmpeq_epi8(block, openBrace), _mm_cmpeq_epi8(block, closeBrace));
+		__m128i brackets = _mm_or_si128(_mm_cmpeq_epi8(block, openBracket), _mm_cmpeq_epi8(block, closeBracket));
+		__m128i separators = _mm_or_si128(_mm_cmpeq_epi8(block, colon), _mm_cmpeq_epi8(block, comma));
+		__m128i strings = _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash));
+		__m128i hits = _mm_or_si128(_mm_or_si128(braces, brackets), _mm_or_si128(separators, strings));
+		pushMask((unsigned int) _mm_movemask_epi8(hits), pos, candidates);
+	}
+	return pos;
+}
+
+__attribute__((target("avx2")))
+size_t JSONScanner::findStructureAVX2(const char* data, size_t from, size_t length,
+		std::vector<size_t>& candidates)
+{
+	const __m256i openBrace = _mm256_set1_epi8('{');
+	const __m256i closeBrace = _mm256_set1_epi8('}');
+	const __m256i openBracket = _mm256_set1_epi8('[');
+	const __m256i closeBracket = _mm256_set1_epi8(']');
+	const __m256i colon = _mm256_set1_epi8(':');
+	const __m256i comma = _mm256_set1_epi8(',');
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	size_t pos = from;
+	for (; pos + 32 <= length; pos += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*) (data + pos));
+		__m256i braces = _mm256_or_si256(_mm256_cmpeq_epi8(block, openBrace), _mm256_cmpeq_epi8(block, closeBrace));
+		__m256i brackets = _mm256_or_si256(_mm256_cmpeq_epi8(block, openBracket), _mm256_cmpeq_epi8(block,
+				closeBracket));
+		__m256i separators = _mm256_or_si256(_mm256_cmpeq_epi8(block, colon), _mm256_cmpeq_epi8(block, comma));
+		__m256i strings = _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash));
+		__m256i hits = _mm256_or_si256(_mm256_or_si256(braces, brackets), _mm256_or_si256(separators, strings));
+		pushMask((unsigned int) _mm256_movemask_epi8(hits), pos, candidates);
+	}
+	return pos;
+}
+
+#else
+
+size_t JSONScanner::findStructureSSE2(const char*, size_t from, size_t,
+		std::vector<size_t>&)
+{
+	return from;
+}
+
+size_t JSONScanner::findStructureAVX2(const char*, size_t from, size_t,
+		std::vector<size_t>&)
+{
+	return from;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef JSONSCANNER_H_
+#define JSONSCANNER_H_
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Builds a structural index of a JSON text in two passes. The first finds
+ * every '{', '}', '[', ']', ':', ',', '"' and '\' with SSE2 on x86, or
+ * AVX2 when the CPU reports it at runtime, and a plain byte loop
+ * everywhere else. The second drops the ones inside strings and pairs up
+ * the brackets, so a reader can step over any object or array in one move.
+ */
+class JSONScanner
+{
+	public:
+		static bool buildIndex(const char* data, size_t length, std::vector<size_t>& tokens,
+				std::vector<size_t>& partners);
+	private:
+		static size_t findStructureScalar(const char* data, size_t from, size_t length,
+				std::vector<size_t>& candidates);
+		static size_t findStructureSSE2(const char* data, size_t from, size_t length,
+				std::vector<size_t>& candidates);
+		static size_t findStructureAVX2(const char* data, size_t from, size_t length,
+				std::vector<size_t>& candidates);
+};
+
+#endif /* JSONSCANNER_H_ */
@@ -0,0 +1,294 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RSSForecastDecoder.h"
+#include <string>
+#include <vector>
+#include <exception>
+#include <string.h>
+
+RSSForecastDecoder::RSSForecastDecoder()
+{
+	xmlParser = new XMLParser();
+	titleQuery = new XMLQuery("rss/channel/item[*]/title");
+	descriptionQuery = new XMLQuery("rss/channel/item[*]/description");
+	forecastQueries.push_back(titleQuery);
+	forecastQueries.push_back(descriptionQuery);
+	streamParser = new XMLStreamParser(this);
+}
+
+RSSForecastDecoder::~RSSForecastDecoder()
+{
+	delete streamParser;
+	delete descriptionQuery;
+	delete titleQuery;
+	delete xmlParser;
+}
+
+/*
+ * An XML Content-Type (but not XHTML), or a document whose root element
+ * is <rss> once any prolog, comments and DOCTYPE are skipped. A leading
+ * '<' alone is not enough: an HTML error page starts with one too.
+ */
+bool RSSForecastDecoder::accepts(const std::string& contentType, const char* data, size_t length)
+{
+	if ((contentType.find("xml") != std::string::npos) && (contentType.find("html") == std::string::npos))
+	{
+		return true;
+	}
+	size_t pos = 0;
+	if ((length >= 3) && (data[0] == '\xEF') && (data[1] == '\xBB') && (data[2] == '\xBF'))
+	{
+		pos = 3;
+	}
+	while (pos < length)
+	{
+		if ((data[pos] == ' ') || (data[pos] == '\t') || (data[pos] == '\r') || (data[pos] == '\n'))
+		{
+			pos++;
+			continue;
+		}
+		if ((pos + 1 < length) && (data[pos] == '<') && ((data[pos + 1] == '?') || (data[pos + 1] == '!')))
+		{
+			const char* close = (const char*) memchr(data + pos, '>', length - pos);
+			if (close == NULL)
+			{
+				return false;
+			}
+			pos = close - data + 1;
+			continue;
+		}
+		break;
+	}
+	XMLSpan root(data + pos, length - pos);
+	return (root.length > 4) && (root.substr(0, 4) == XMLSpan("<rss")) && (root.findFirstOf(" \t\r\n>") == 4);
+}
+
+/*
+ * The parser borrows 'data' and every field is read as a span into it, so
+ * the only copies made are the strings kept in 'day'. One query pass
+ * collects the title and description of every item; fewer than three of
+ * either means this is not a forecast, whatever it parsed as.
+ */
+bool RSSForecastDecoder::decode(const char* data, size_t length, FORECAST* day)
+{
+	xmlParser->setSource(data, length);
+	xmlParser->runQueries(forecastQueries);
+	if ((titleQuery->getMatchCount() < 3) || (descriptionQuery->getMatchCount() < 3))
+	{
+		return false;
+	}
+	try
+	{
+		for (int currentDay = 0; currentDay < 3; currentDay++)
+		{
+			parseTitle(titleQuery->getMatch(1 + currentDay), day[currentDay]);
+			parseDescription(descriptionQuery->getMatch(1 + currentDay), day[currentDay]);
+		}
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Starts on a body that accepts() would take, feeding it the first block.
+ */
+bool RSSForecastDecoder::beginStream(const std::string& contentType, const char* data, size_t length)
+{
+	if (!accepts(contentType, data, length))
+	{
+		return false;
+	}
+	streamParser->reset();
+	streamDepth = 0;
+	pathDepth = 0;
+	itemCount = 0;
+	capture = NULL;
+	titleCount = 0;
+	descriptionCount = 0;
+	for (int currentDay = 0; currentDay < 3; currentDay++)
+	{
+		streamTitles[currentDay].clear();
+		streamDescriptions[currentDay].clear();
+	}
+	streamParser->feed(data, length);
+	return true;
+}
+
+void RSSForecastDecoder::feedStream(const char* data, size_t length)
+{
+	streamParser->feed(data, length);
+}
+
+/*
+ * Needs a well formed document with at least three items, as decode()
+ * does; anything less is left to decode() on the whole body.
+ */
+bool RSSForecastDecoder::finishStream(FORECAST* day)
+{
+	std::string errorMessage;
+	if (!streamParser->finish(errorMessage) || (titleCount < 3) || (descriptionCount < 3))
+	{
+		return false;
+	}
+	try
+	{
+		for (int currentDay = 0; currentDay < 3; currentDay++)
+		{
+			parseTitle(XMLSpan(streamTitles[currentDay]), day[currentDay]);
+			parseDescription(XMLSpan(streamDescriptions[currentDay]), day[currentDay]);
+		}
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Follows the same path as titleQuery and descriptionQuery. The text
+ * kept for a field is what the query would give: everything up to the
+ * next tag, which may arrive over several calls.
+ */
+void RSSForecastDecoder::openTag(XMLSpan name)
+{
+	capture = NULL;
+	streamDepth++;
+	if (pathDepth != streamDepth - 1)
+	{
+		return;
+	}
+	static const char* const path[] = { "rss", "channel", "item" };
+	if (streamDepth <= 3)
+	{
+		if (name == XMLSpan(path[streamDepth - 1]))
+		{
+			pathDepth = streamDepth;
+			if (streamDepth == 3)
+			{
+				itemCount++;
+			}
+		}
+		return;
+	}
+	if ((streamDepth == 4) && (itemCount <= 3))
+	{
+		if ((name == XMLSpan("title")) && (titleCount < 3))
+		{
+			capture = &streamTitles[titleCount++];
+		}
+		else if ((name == XMLSpan("description")) && (descriptionCount < 3))
+		{
+			capture = &streamDescriptions[descriptionCount++];
+		}
+	}
+}
+
+void RSSForecastDecoder::closeTag(XMLSpan)
+{
+	capture = NULL;
+	if (pathDepth == streamDepth)
+	{
+		pathDepth--;
+	}
+	streamDepth--;
+}
+
+void RSSForecastDecoder::text(XMLSpan content)
+{
+	if (capture != NULL)
+	{
+		capture->append(content.data, content.length);
+	}
+}
+
+/*
+ * "Monday: Sunny Intervals, Maximum Temperature: ..." gives the day name
+ * (up to the first ':') and the overview (from there up to the next ',').
+ */
+void RSSForecastDecoder::parseTitle(XMLSpan title, FORECAST& forecast)
+{
+	size_t colon = title.find(":");
+	if (colon == XMLSpan::npos)
+	{
+		forecast.day.clear();
+		forecast.description.clear();
+		return;
+	}
+	forecast.day.assign(title.data, colon);
+	XMLSpan overview = title.substr(colon + 1);
+	while ((overview.length != 0) && (overview.data[0] == ' '))
+	{
+		overview = overview.substr(1);
+	}
+	size_t comma = overview.find(",");
+	forecast.description.assign(overview.data, (comma != XMLSpan::npos) ? comma : overview.length);
+}
+
+/*
+ * Single pass over "Key: value, Key: value, ..." picking out the fields we
+ * keep. Unknown keys are skipped, and if there is no maximum temperature
+ * the minimum is used for both.
+ */
+void RSSForecastDecoder::parseDescription(XMLSpan description, FORECAST& forecast)
+{
+	bool haveMax = false;
+	size_t fieldStart = 0;
+	while (fieldStart < description.length)
+	{
+		XMLSpan field = description.substr(fieldStart);
+		size_t fieldEnd = field.find(",");
+		if (fieldEnd != XMLSpan::npos)
+		{
+			field = field.substr(0, fieldEnd);
+		}
+		fieldStart += field.length + 1;
+		while ((field.length != 0) && (field.data[0] == ' '))
+		{
+			field = field.substr(1);
+		}
+		size_t separator = field.find(": ");
+		if (separator == XMLSpan::npos)
+		{
+			continue;
+		}
+		XMLSpan key = field.substr(0, separator);
+		XMLSpan value = field.substr(separator + 2);
+		if (key == XMLSpan("Minimum Temperature"))
+		{
+			spanToInt(value, forecast.minTemp);
+		}
+		else if (key == XMLSpan("Maximum Temperature"))
+		{
+			haveMax = spanToInt(value, forecast.maxTemp);
+		}
+		else if (key == XMLSpan("Wind Direction"))
+		{
+			forecast.windDirection.assign(value.data, value.length);
+		}
+		else if (key == XMLSpan("Wind Speed"))
+		{
+			spanToInt(value, forecast.windSpeed);
+		}
+	}
+	if (!haveMax)
+	{
+		forecast.maxTemp = forecast.minTemp; // No max found!
+	}
+}
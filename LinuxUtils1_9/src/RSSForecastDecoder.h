@@ -0,0 +1,50 @@
+#ifndef RSSFORECASTDECODER_H_
+#define RSSFORECASTDECODER_H_
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "ForecastDecoder.h"
+#include "XMLParser.h"
+#include "XMLQuery.h"
+#include "XMLStreamParser.h"
+#include "XMLSpan.h"
+
+/*
+ * The BBC three day forecast RSS: item n of the channel is day n, its
+ * title gives the day and overview and its description the figures.
+ * Streamed bodies go through an XMLStreamParser as they arrive, keeping
+ * only the text of the first three titles and descriptions.
+ */
+class RSSForecastDecoder: public ForecastDecoder, public XMLStreamListener
+{
+	public:
+		RSSForecastDecoder();
+		virtual ~RSSForecastDecoder();
+		virtual bool accepts(const std::string& contentType, const char* data, size_t length);
+		virtual bool decode(const char* data, size_t length, FORECAST* day);
+		virtual bool beginStream(const std::string& contentType, const char* data, size_t length);
+		virtual void feedStream(const char* data, size_t length);
+		virtual bool finishStream(FORECAST* day);
+		virtual void openTag(XMLSpan name);
+		virtual void closeTag(XMLSpan name);
+		virtual void text(XMLSpan content);
+	private:
+		void parseTitle(XMLSpan title, FORECAST& forecast);
+		void parseDescription(XMLSpan description, FORECAST& forecast);
+		XMLParser* xmlParser;
+		XMLQuery* titleQuery;
+		XMLQuery* descriptionQuery;
+		std::vector<XMLQuery*> forecastQueries;
+		XMLStreamParser* streamParser;
+		int streamDepth; // elements open in the streamed body
+		int pathDepth; // how many of them are on rss/channel/item/title or .../description
+		int itemCount; // items seen so far
+		std::string* capture; // field receiving text, or NULL
+		std::string streamTitles[3];
+		std::string streamDescriptions[3];
+		int titleCount;
+		int descriptionCount;
+};
+
+#endif /* RSSFORECASTDECODER_H_ */
@@ -0,0 +1,44 @@
+#ifndef SCANNERSUPPORT_H_
+#define SCANNERSUPPORT_H_
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Pieces shared by the vectorised scanners (XMLScanner, JSONScanner).
+ * Internal to them: included only from their .cpp files. SCANNER_X86 is
+ * defined where the SSE2 and AVX2 loops can be built, and is also what
+ * GammaCurve's SSE2 ramp fill is built on.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SCANNER_X86 1
+#include <immintrin.h>
+
+// Push the offsets of the set bits in 'mask', lowest first.
+template<typename Offset>
+static inline void pushMask(unsigned int mask, size_t base, std::vector<Offset>& offsets)
+{
+	while (mask != 0)
+	{
+		offsets.push_back((Offset) (base + __builtin_ctz(mask)));
+		mask &= mask - 1;
+	}
+}
+
+// Checked once per process; AVX2 code is only built with a target attribute.
+static inline bool cpuHasAVX2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+
+#else
+
+static inline bool cpuHasAVX2()
+{
+	return false;
+}
+
+#endif
+
+#endif /* SCANNERSUPPORT_H_ */
@@ -14,31 +14,268 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "WeatherData.h"
+#include "RSSForecastDecoder.h"
+#include "JSONForecastDecoder.h"
 #include <string>
+#include <map>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fstream>
-#include <sstream>
 #include <pthread.h>
 #include <algorithm>	// For character replacement
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <errno.h>
+
+static const long long REFRESH_INTERVAL = 30 * 60 * 1000; // milliseconds
+static const long long BACKOFF_MINIMUM = 5 * 1000;
+static const long long BACKOFF_MAXIMUM = 10 * 60 * 1000;
+static const char CACHE_MAGIC[] = "LinuxUtils weather cache 1";
+
 WeatherData::WeatherData()
 {
-	dataGrabbed = false;
-	xmlParser = new XMLParser();
+	threadStarted = false;
+	fetchRunning = 0;
+	fetchResult = FETCH_NONE;
+	fetchStats.issued = 0;
+	fetchStats.skipped = 0;
+	fetchStats.failed = 0;
+	fetchTimeout = 60000;
+	// differs between processes and between instances, so their retries spread out
+	jitterSeed = (unsigned int) time(NULL) ^ ((unsigned int) getpid() << 16) ^ (unsigned int) (size_t) this;
+	nextFetchDue = 0;
+	consecutiveFailures = 0;
+	lastFetchOK = false;
+	lastRouteCheck = 0;
+	lastRouteCount = 0;
+	cacheTime = 0;
+	activeReaders = 0;
+	lastTiming.resolve = 0;
+	lastTiming.connect = 0;
+	lastTiming.transfer = 0;
+	lastTiming.parse = 0;
+	pthread_mutex_init(&fetchLock, NULL);
+	pthread_condattr_t fetchDoneAttributes;
+	pthread_condattr_init(&fetchDoneAttributes);
+	pthread_condattr_setclock(&fetchDoneAttributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&fetchDone, &fetchDoneAttributes);
+	pthread_condattr_destroy(&fetchDoneAttributes);
+	currentSnapshot = new SNAPSHOT();
+	currentSnapshot->generation = 0;
+	httpClient = new HTTPClient();
+	httpClient->setBodyListener(this);
+	streamDecoder = NULL;
+	streamOffered = false;
+	streamWanted = false;
+	decoders.push_back(new RSSForecastDecoder());
+	decoders.push_back(new JSONForecastDecoder());
+	history = new ForecastHistory();
 }
 
 WeatherData::~WeatherData()
 {
-	//pthread_join(threadMethod, NULL);
-	delete xmlParser;
+	if (threadStarted)
+	{
+		pthread_join(threadMethod, NULL);
+	}
+	for (size_t retired = 0; retired < retiredSnapshots.size(); retired++)
+	{
+		delete retiredSnapshots[retired];
+	}
+	delete currentSnapshot;
+	pthread_cond_destroy(&fetchDone);
+	pthread_mutex_destroy(&fetchLock);
+	for (size_t decoder = 0; decoder < decoders.size(); decoder++)
+	{
+		delete decoders[decoder];
+	}
+	delete history;
+	delete httpClient;
+}
+
+/*
+ * Adds a decoder for another feed layout, tried before those already
+ * known. The WeatherData deletes it. Only call while no fetch is running.
+ */
+void WeatherData::addDecoder(ForecastDecoder* decoder)
+{
+	decoders.insert(decoders.begin(), decoder);
+}
+
+/*
+ * Starts a fetch on the background thread and returns at once. Ignored if
+ * a fetch is already running, or if the cached forecast is still fresh.
+ * Returns true if a fetch was started; the new forecast is published
+ * when it is done.
+ */
+bool WeatherData::updateWeatherData(std::string XML)
+{
+	collectFetchResult();
+	return startFetch(XML);
+}
+
+/*
+ * Call as often as you like (e.g. every frame). Starts a fetch only when
+ * one is due: the forecast is older than REFRESH_INTERVAL, or the backoff
+ * after a failure has run out, or the default route has changed since the
+ * failure. Returns true if a fetch was started.
+ */
+bool WeatherData::refreshWeatherData(std::string XML)
+{
+	collectFetchResult();
+	long long now = monotonicMilliseconds();
+	if ((consecutiveFailures != 0) && (now - lastRouteCheck >= 1000))
+	{
+		// offline? retry straight away if the network comes back
+		lastRouteCheck = now;
+		int routes = defaultRouteCount();
+		if (routes != lastRouteCount)
+		{
+			lastRouteCount = routes;
+			if (routes != 0)
+			{
+				nextFetchDue = now;
+			}
+		}
+	}
+	if ((now < nextFetchDue) || (!startFetch(XML)))
+	{
+		fetchStats.skipped++;
+		return false;
+	}
+	return true;
+}
+
+bool WeatherData::isFetching()
+{
+	return __atomic_load_n(&fetchRunning, __ATOMIC_SEQ_CST) != 0;
+}
+
+WeatherData::FETCH_STATS WeatherData::getFetchStats()
+{
+	collectFetchResult();
+	return fetchStats;
 }
 
-void WeatherData::updateWeatherData(std::string XML)
+bool WeatherData::startFetch(const std::string& XML)
 {
-	// spawn thread, update value of dataGrabbed on completion.
+	int idle = 0;
+	if (!__atomic_compare_exchange_n(&fetchRunning, &idle, 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+	{
+		return false;
+	}
+	if (threadStarted)
+	{
+		// finished already, so this returns straight away
+		pthread_join(threadMethod, NULL);
+		threadStarted = false;
+	}
+	if (XML != cacheURL)
+	{
+		loadCache(XML);
+		history->openFile(historyFilePath(XML));
+	}
+	long long cacheAge = (long long) (time(NULL) - cacheTime) * 1000;
+	if ((cacheTime != 0) && (cacheAge >= 0) && (cacheAge < REFRESH_INTERVAL))
+	{
+		// the cached forecast is still fresh
+		nextFetchDue = monotonicMilliseconds() + REFRESH_INTERVAL - cacheAge;
+		__atomic_store_n(&fetchRunning, 0, __ATOMIC_SEQ_CST);
+		return false;
+	}
+	httpClient->setTimeouts(std::min(fetchTimeout, 5000), std::min(fetchTimeout, 10000), fetchTimeout);
+	httpClient->clearRequestHeaders();
+	httpClient->setRequestHeader("Accept-Encoding", "gzip, deflate");
+	if (cacheETag.length() != 0)
+	{
+		httpClient->setRequestHeader("If-None-Match", cacheETag);
+	}
+	if (cacheLastModified.length() != 0)
+	{
+		httpClient->setRequestHeader("If-Modified-Since", cacheLastModified);
+	}
 	weatherXML = XML;
-	//pthread_create(&threadMethod, 0, WeatherData::start_thread, this);
-			getDataThread();
+	threadStarted = (pthread_create(&threadMethod, 0, WeatherData::start_thread, this) == 0);
+	if (!threadStarted)
+	{
+		__atomic_store_n(&fetchRunning, 0, __ATOMIC_SEQ_CST);
+		return false;
+	}
+	fetchStats.issued++;
+	return true;
+}
+
+/*
+ * Picks up the outcome of a finished fetch and schedules the next one:
+ * REFRESH_INTERVAL after a success, or after a failure a backoff that
+ * doubles each time, up to BACKOFF_MAXIMUM, with up to 25% random jitter.
+ */
+void WeatherData::collectFetchResult()
+{
+	int result = __atomic_exchange_n(&fetchResult, FETCH_NONE, __ATOMIC_SEQ_CST);
+	if (result == FETCH_NONE)
+	{
+		return;
+	}
+	long long now = monotonicMilliseconds();
+	lastFetchOK = (result == FETCH_OK);
+	if (result == FETCH_OK)
+	{
+		consecutiveFailures = 0;
+		nextFetchDue = now + REFRESH_INTERVAL;
+		return;
+	}
+	fetchStats.failed++;
+	long long backoff = BACKOFF_MINIMUM;
+	for (int doubling = 0; (doubling < consecutiveFailures) && (backoff < BACKOFF_MAXIMUM); doubling++)
+	{
+		backoff *= 2;
+	}
+	if (backoff > BACKOFF_MAXIMUM)
+	{
+		backoff = BACKOFF_MAXIMUM;
+	}
+	backoff -= (backoff / 4) * (rand_r(&jitterSeed) % 1000) / 1000;
+	consecutiveFailures++;
+	nextFetchDue = now + backoff;
+	lastRouteCount = defaultRouteCount();
+	lastRouteCheck = now;
+}
+
+long long WeatherData::monotonicMilliseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * Number of default routes in the kernel routing table. Zero usually
+ * means there is no network to fetch from.
+ */
+int WeatherData::defaultRouteCount()
+{
+	int routes = 0;
+	FILE* routeTable = fopen("/proc/net/route", "r");
+	if (routeTable == NULL)
+	{
+		return 0;
+	}
+	char line[256];
+	while (fgets(line, sizeof(line), routeTable) != NULL)
+	{
+		char interface[64];
+		char destination[64];
+		if ((sscanf(line, "%63s %63s", interface, destination) == 2) && (strcmp(destination, "00000000") == 0))
+		{
+			routes++;
+		}
+	}
+	fclose(routeTable);
+	return routes;
 }
 
 void* WeatherData::start_thread(void *obj)
@@ -48,91 +285,350 @@ void* WeatherData::start_thread(void *obj)
 	return 0;
 }
 
+/*
+ * Fetches the feed in-process, straight into memory. A decoder that
+ * can stream parses the body while it arrives (see bodyData); any other
+ * body is parsed once complete. The HTTP connection is kept open for the
+ * next refresh.
+ */
 void WeatherData::getDataThread()
 {
-	std::string xmlContents = "";
-	std::string textLine = "";
-	std::string com = "wget --no-proxy -qO .weather " + weatherXML;
-	const char* comm = &com[0];
-	system(comm);
-	std::ifstream myfile(".weather");
-	if (myfile.is_open())
+	HTTPClient::Response response;
+	SNAPSHOT* fresh = new SNAPSHOT();
+	streamDecoder = NULL;
+	bool fetched = httpClient->get(weatherXML, response);
+	HTTPClient::Timing transfer = httpClient->getLastTiming();
+	FETCH_TIMING timing;
+	timing.resolve = transfer.resolve;
+	timing.connect = transfer.connect;
+	timing.transfer = transfer.transfer;
+	timing.parse = 0;
+	int result = FETCH_FAILED;
+	bool parsed = false;
+	if (fetched && (response.status == 200) && (response.body.length() != 0))
 	{
-		while (myfile.good())
+		struct timespec started, finished;
+		clock_gettime(CLOCK_MONOTONIC, &started);
+		// most of the work was done by the stream decoder during the transfer
+		parsed = (streamDecoder != NULL) && streamDecoder->finishStream(fresh->day);
+		parsed = parsed || parseFeed(response.body, response.headers["content-type"], fresh->day);
+		clock_gettime(CLOCK_MONOTONIC, &finished);
+		timing.parse = (finished.tv_sec - started.tv_sec) * 1000.0 + (finished.tv_nsec - started.tv_nsec)
+				/ 1000000.0;
+	}
+	if (fetched && (response.status == 304) && (currentSnapshot->generation != 0))
+	{
+		// unchanged upstream, so the cached forecast stands without parsing
+		delete fresh;
+		__atomic_store_n(&cacheTime, time(NULL), __ATOMIC_SEQ_CST);
+		utimes(cacheFilePath(weatherXML).c_str(), NULL);
+		result = FETCH_OK;
+	}
+	else if (parsed)
+	{
+		publishSnapshot(fresh);
+		cacheETag = response.headers["etag"];
+		cacheLastModified = response.headers["last-modified"];
+		__atomic_store_n(&cacheTime, time(NULL), __ATOMIC_SEQ_CST);
+		saveCache(weatherXML, *fresh, response.body);
+		history->append(cacheTime, fresh->day);
+		result = FETCH_OK;
+	}
+	else
+	{
+		delete fresh;
+	}
+	// published together, so a waiter never sees one fetch's result with another's timing
+	pthread_mutex_lock(&fetchLock);
+	lastTiming = timing;
+	__atomic_store_n(&fetchResult, result, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&fetchRunning, 0, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&fetchDone);
+	pthread_mutex_unlock(&fetchLock);
+}
+
+/*
+ * Blocks, without using any CPU, until the fetch in progress finishes or
+ * 'timeoutMilliseconds' pass. Returns true if no fetch is running.
+ */
+bool WeatherData::waitForFetch(int timeoutMilliseconds)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeoutMilliseconds / 1000;
+	deadline.tv_nsec += (long) (timeoutMilliseconds % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&fetchLock);
+	while (__atomic_load_n(&fetchRunning, __ATOMIC_SEQ_CST) != 0)
+	{
+		if (pthread_cond_timedwait(&fetchDone, &fetchLock, &deadline) == ETIMEDOUT)
 		{
-			getline(myfile, textLine);
-			xmlContents += textLine;
+			break;
 		}
-		myfile.close();
 	}
-	if ((xmlContents.length() != 0) && (parseXML(xmlContents) != false))
+	bool finished = (__atomic_load_n(&fetchRunning, __ATOMIC_SEQ_CST) == 0);
+	pthread_mutex_unlock(&fetchLock);
+	return finished;
+}
+
+/*
+ * Bounds each fetch started from now on to 'milliseconds' in all, so the
+ * fetch thread ends by then whether or not the server answers; a running
+ * fetch keeps the limit it started with.
+ */
+void WeatherData::setFetchTimeout(int milliseconds)
+{
+	fetchTimeout = (milliseconds > 0) ? milliseconds : 1;
+}
+
+/*
+ * Time taken by each stage of the last finished fetch. Only meaningful
+ * once waitForFetch has returned true.
+ */
+WeatherData::FETCH_TIMING WeatherData::getLastFetchTiming()
+{
+	pthread_mutex_lock(&fetchLock);
+	FETCH_TIMING timing = lastTiming;
+	pthread_mutex_unlock(&fetchLock);
+	return timing;
+}
+
+/*
+ * Swaps in 'fresh' as the current forecast. The one it replaces is
+ * retired, and retired snapshots are freed at a moment when no reader is
+ * active: any reader arriving after the swap can only see 'fresh'.
+ * Only called by whoever holds fetchRunning: the fetch thread, or
+ * startFetch when loading the cache.
+ */
+void WeatherData::publishSnapshot(SNAPSHOT* fresh)
+{
+	fresh->generation = currentSnapshot->generation + 1;
+	SNAPSHOT* previous = __atomic_exchange_n(&currentSnapshot, fresh, __ATOMIC_SEQ_CST);
+	retiredSnapshots.push_back(previous);
+	if (__atomic_load_n(&activeReaders, __ATOMIC_SEQ_CST) == 0)
 	{
-		dataGrabbed = true;
+		for (size_t retired = 0; retired < retiredSnapshots.size(); retired++)
+		{
+			delete retiredSnapshots[retired];
+		}
+		retiredSnapshots.clear();
 	}
 }
 
-bool WeatherData::parseXML(std::string xmlData)
+/*
+ * Returns the latest forecast without blocking. The snapshot stays valid
+ * until the matching releaseSnapshot call.
+ */
+const WeatherData::SNAPSHOT* WeatherData::acquireSnapshot()
+{
+	__atomic_add_fetch(&activeReaders, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&currentSnapshot, __ATOMIC_SEQ_CST);
+}
+
+void WeatherData::releaseSnapshot()
 {
-	xmlParser->setSource(xmlData);
-	try
+	__atomic_sub_fetch(&activeReaders, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * The cache file for 'url': one per feed, under $XDG_CACHE_HOME/linuxutils
+ * (or ~/.cache/linuxutils), named by a hash of the URL. Empty if no cache
+ * directory can be found or created.
+ */
+std::string WeatherData::cacheFilePath(const std::string& url)
+{
+	std::string directory;
+	const char* cacheHome = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	if ((cacheHome != NULL) && (cacheHome[0] == '/'))
+	{
+		directory = cacheHome;
+	}
+	else if ((home != NULL) && (home[0] != '\0'))
+	{
+		directory = std::string(home) + "/.cache";
+	}
+	else
+	{
+		return "";
+	}
+	mkdir(directory.c_str(), 0700);
+	directory += "/linuxutils";
+	mkdir(directory.c_str(), 0700);
+	unsigned int hash = 2166136261u;
+	for (size_t pos = 0; pos < url.length(); pos++)
 	{
-		for (int currentDay = 0; currentDay < 3; currentDay++)
+		hash ^= (unsigned char) url[pos];
+		hash *= 16777619u;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "/weather-%08x.cache", hash);
+	return directory + name;
+}
+
+/*
+ * The forecast history for 'url', kept beside its cache file.
+ */
+std::string WeatherData::historyFilePath(const std::string& url)
+{
+	std::string path = cacheFilePath(url);
+	size_t suffix = path.rfind(".cache");
+	if (suffix != std::string::npos)
+	{
+		path.replace(suffix, std::string::npos, ".history");
+	}
+	return path;
+}
+
+/*
+ * When the forecast was last fetched or confirmed unchanged by the feed
+ * (seconds since the epoch), or 0 if there is none.
+ */
+time_t WeatherData::getLastUpdated()
+{
+	return __atomic_load_n(&cacheTime, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Past forecasts for the feed last fetched, newest first. Opened by the
+ * first refresh; empty before then.
+ */
+ForecastHistory* WeatherData::getHistory()
+{
+	return history;
+}
+
+/*
+ * Loads the cached forecast for 'url', if there is one, and publishes it
+ * straight away. Sets the validators and the time it was last confirmed
+ * against the feed (the file's modification time). Only called while no
+ * fetch is running.
+ */
+void WeatherData::loadCache(const std::string& url)
+{
+	cacheURL = url;
+	cacheETag.clear();
+	cacheLastModified.clear();
+	cacheTime = 0;
+	std::string path = cacheFilePath(url);
+	struct stat fileInfo;
+	if ((path.length() == 0) || (stat(path.c_str(), &fileInfo) != 0))
+	{
+		return;
+	}
+	std::ifstream cacheFile(path.c_str());
+	std::string line;
+	if (!getline(cacheFile, line) || (line != CACHE_MAGIC) || !getline(cacheFile, line) || (line != "url "
+			+ url))
+	{
+		return;
+	}
+	SNAPSHOT* cached = new SNAPSHOT();
+	std::string etag, lastModified;
+	int days = 0;
+	while (getline(cacheFile, line) && (line.compare(0, 5, "body ") != 0))
+	{
+		if (line.compare(0, 5, "etag ") == 0)
 		{
-			std::string fullTitle = xmlParser->getTagValue("title", 3 + currentDay);
-			std::string fullDescription = xmlParser->getTagValue("description", 2 + currentDay);
-			// DAY NAME
-			day[currentDay].day = getParameter(fullTitle, "", ":");
-			// DAY DESCRIPTION
-			std::string desc = getParameter(fullTitle, ": ", ",");
-			day[currentDay].description = desc;
-			// MIN TEMP
-			std::string minTemp = getParameter(fullDescription, "Minimum Temperature: ", "");
-			sscanf(&minTemp[0], "%d", &day[currentDay].minTemp);
-			// MAX TEMP
-			std::string maxTemp = getParameter(fullDescription, "Maximum Temperature: ", "");
-			if (maxTemp.length() != 0)
+			etag = line.substr(5);
+		}
+		else if (line.compare(0, 13, "lastmodified ") == 0)
+		{
+			lastModified = line.substr(13);
+		}
+		else if ((line.compare(0, 4, "day ") == 0) && (days < 3))
+		{
+			std::vector<std::string> fields;
+			size_t start = 4;
+			size_t tab;
+			while ((tab = line.find('\t', start)) != std::string::npos)
 			{
-				sscanf(&maxTemp[0], "%d", &day[currentDay].maxTemp);
+				fields.push_back(line.substr(start, tab - start));
+				start = tab + 1;
 			}
-			else
+			fields.push_back(line.substr(start));
+			if (fields.size() != 6)
 			{
-				day[currentDay].maxTemp = day[currentDay].minTemp; // No max found!
+				break;
 			}
-			// WIND DIRECTION
-			std::string windDir = getParameter(fullDescription, "Wind Direction: ", ",");
-			day[currentDay].windDirection = windDir;
-			// WIND SPEED
-			std::string windSpeed = getParameter(fullDescription, "Wind Speed: ", "m");
-			sscanf(&windSpeed[0], "%d",	&day[currentDay].windSpeed);
+			FORECAST& forecast = cached->day[days];
+			forecast.day = fields[0];
+			forecast.description = fields[1];
+			forecast.maxTemp = atoi(fields[2].c_str());
+			forecast.minTemp = atoi(fields[3].c_str());
+			forecast.windDirection = fields[4];
+			forecast.windSpeed = atoi(fields[5].c_str());
+			days++;
 		}
 	}
-	catch (std::exception exc)
+	if (days != 3)
 	{
-		return false;
+		delete cached;
+		return;
 	}
-	return true;
+	publishSnapshot(cached);
+	cacheETag = etag;
+	cacheLastModified = lastModified;
+	cacheTime = fileInfo.st_mtime;
 }
 
-std::string WeatherData::getParameter(std::string text, std::string keyValue, std::string delimit)
+/*
+ * Writes the forecast, its validators and the raw feed for 'url' to the
+ * cache. Written to a temporary file and renamed into place, so a reader
+ * never sees half a file.
+ */
+void WeatherData::saveCache(const std::string& url, const SNAPSHOT& snapshot, const std::string& body)
 {
-	if (delimit.length() == 0)
+	std::string path = cacheFilePath(url);
+	if (path.length() == 0)
+	{
+		return;
+	}
+	std::string temporary = path + ".tmp";
+	std::ofstream cacheFile(temporary.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	cacheFile << CACHE_MAGIC << "\n";
+	cacheFile << "url " << url << "\n";
+	cacheFile << "etag " << cacheETag << "\n";
+	cacheFile << "lastmodified " << cacheLastModified << "\n";
+	for (int thisDay = 0; thisDay < 3; thisDay++)
 	{
-		delimit ="° ,%";
+		const FORECAST& forecast = snapshot.day[thisDay];
+		cacheFile << "day " << cacheField(forecast.day) << "\t" << cacheField(forecast.description) << "\t"
+				<< forecast.maxTemp << "\t" << forecast.minTemp << "\t" << cacheField(forecast.windDirection)
+				<< "\t" << forecast.windSpeed << "\n";
 	}
-	int length = keyValue.length();
-	uint start = text.find(keyValue);
-	int start2 = start + length;
-	uint end = text.substr(start2).find_first_of(delimit);
-	if ((start != std::string::npos) && (end != std::string::npos))
+	cacheFile << "body " << body.length() << "\n";
+	cacheFile.write(body.data(), body.length());
+	cacheFile.close();
+	if (cacheFile.fail() || (rename(temporary.c_str(), path.c_str()) != 0))
 	{
-		return text.substr(start2, end);
+		unlink(temporary.c_str());
 	}
-	return "";
+}
+
+/*
+ * 'text' with tabs and line breaks turned into spaces, so it fits in one
+ * tab separated field.
+ */
+std::string WeatherData::cacheField(const std::string& text)
+{
+	std::string field = text;
+	std::replace(field.begin(), field.end(), '\t', ' ');
+	std::replace(field.begin(), field.end(), '\n', ' ');
+	std::replace(field.begin(), field.end(), '\r', ' ');
+	return field;
 }
 
 void WeatherData::forecastToTerminal()
 {
+	const SNAPSHOT* snapshot = acquireSnapshot();
+	const FORECAST* day = snapshot->day;
 	std::string output = "";
+	output.reserve(512);
 	for (int thisDay = 0; thisDay < 3; thisDay++)
 	{
 		output += day[thisDay].day;
@@ -141,31 +637,197 @@ void WeatherData::forecastToTerminal()
 		output += day[thisDay].description;
 		output += "\n";
 		output += "Max Temp: ";
-		output += intToString(day[thisDay].maxTemp);
+		appendInt(output, day[thisDay].maxTemp);
 		output += " C";
 		output += "\n";
 		output += "Min Temp: ";
-		output += intToString(day[thisDay].minTemp);
+		appendInt(output, day[thisDay].minTemp);
 		output += " C";
 		output += "\n";
 		output += "Wind Direction: ";
 		output += day[thisDay].windDirection;
 		output += "\n";
 		output += "Wind Speed: ";
-		output += intToString(day[thisDay].windSpeed);
+		appendInt(output, day[thisDay].windSpeed);
 		output += " mph\n\n";
 	}
+	releaseSnapshot();
 	printf("%s", &output[0]);
 }
 
 bool WeatherData::isDataValid()
 {
-	return dataGrabbed;
+	const SNAPSHOT* snapshot = acquireSnapshot();
+	bool valid = (snapshot->generation != 0);
+	releaseSnapshot();
+	return valid;
+}
+
+/*
+ * Whether the forecast was confirmed by the feed recently enough that no
+ * fetch is due yet. A forecast loaded from a stale cache is valid but
+ * not fresh.
+ */
+bool WeatherData::isDataFresh()
+{
+	time_t confirmed = __atomic_load_n(&cacheTime, __ATOMIC_SEQ_CST);
+	long long age = (long long) (time(NULL) - confirmed) * 1000;
+	return (confirmed != 0) && (age >= 0) && (age < REFRESH_INTERVAL);
+}
+
+/*
+ * Whether the last fetch to finish brought a forecast (or confirmed the
+ * cached one). False until a fetch has finished.
+ */
+bool WeatherData::lastFetchSucceeded()
+{
+	collectFetchResult();
+	return lastFetchOK;
 }
 
-std::string WeatherData::intToString(int value)
+/*
+ * Prints how today's forecast high and low have moved over the recent
+ * fetches, oldest on the left, as two lines of block characters on a
+ * shared scale.
+ */
+void WeatherData::historyToTerminal()
 {
-	std::stringstream ss;
-	ss << value;
-	return ss.str();
+	static const char* const blocks[] =
+	{ "\xE2\x96\x81", "\xE2\x96\x82", "\xE2\x96\x83", "\xE2\x96\x84", "\xE2\x96\x85", "\xE2\x96\x86",
+			"\xE2\x96\x87", "\xE2\x96\x88" };
+	const size_t width = 60;
+	int maxima[width];
+	int minima[width];
+	size_t count = 0;
+	size_t available = history->getCount();
+	for (size_t age = 0; (age < available) && (count < width); age++)
+	{
+		ForecastHistory::RECORD record;
+		if (history->getRecord(age, record))
+		{
+			maxima[count] = record.maxTemp[0];
+			minima[count] = record.minTemp[0];
+			count++;
+		}
+	}
+	if (count == 0)
+	{
+		return;
+	}
+	int low = minima[0];
+	int high = maxima[0];
+	for (size_t entry = 0; entry < count; entry++)
+	{
+		low = std::min(low, std::min(minima[entry], maxima[entry]));
+		high = std::max(high, std::max(minima[entry], maxima[entry]));
+	}
+	int range = std::max(high - low, 1);
+	std::string output = "Today over the last ";
+	appendInt(output, (int) count);
+	output += (count == 1) ? " forecast (" : " forecasts (";
+	appendInt(output, low);
+	output += " C to ";
+	appendInt(output, high);
+	output += " C)\n  Hi ";
+	for (size_t entry = count; entry > 0; entry--)
+	{
+		output += blocks[(maxima[entry - 1] - low) * 7 / range];
+	}
+	output += "\n  Lo ";
+	for (size_t entry = count; entry > 0; entry--)
+	{
+		output += blocks[(minima[entry - 1] - low) * 7 / range];
+	}
+	output += "\n";
+	printf("%s", &output[0]);
+}
+
+/*
+ * Decodes the feed with the first decoder that recognises it.
+ */
+bool WeatherData::parseFeed(const std::string& body, const std::string& contentType, FORECAST* day)
+{
+	for (size_t decoder = 0; decoder < decoders.size(); decoder++)
+	{
+		if (decoders[decoder]->accepts(contentType, body.data(), body.length()))
+		{
+			return decoders[decoder]->decode(body.data(), body.length(), day);
+		}
+	}
+	return false;
+}
+
+/*
+ * Called on the fetch thread as each response starts. Only a 200 body
+ * can be a forecast; redirects and error pages are not offered.
+ */
+void WeatherData::bodyBegin(const HTTPClient::Response& response)
+{
+	std::map<std::string, std::string>::const_iterator contentType = response.headers.find("content-type");
+	streamContentType = (contentType != response.headers.end()) ? contentType->second : "";
+	streamWanted = (response.status == 200);
+	streamOffered = false;
+	streamStart.clear();
+	streamDecoder = NULL;
+}
+
+/*
+ * Hands decoded blocks to the first decoder that takes the body, in the
+ * order parseFeed() tries them, so parsing runs during the transfer. A
+ * short first block may not show what the body is, so up to 512 bytes
+ * are gathered before giving up on streaming.
+ */
+void WeatherData::bodyData(const char* data, size_t length)
+{
+	if (!streamWanted)
+	{
+		return;
+	}
+	if (streamOffered)
+	{
+		if (streamDecoder != NULL)
+		{
+			streamDecoder->feedStream(data, length);
+		}
+		return;
+	}
+	streamStart.append(data, length);
+	for (size_t decoder = 0; decoder < decoders.size(); decoder++)
+	{
+		if (decoders[decoder]->accepts(streamContentType, streamStart.data(), streamStart.length()))
+		{
+			if (decoders[decoder]->beginStream(streamContentType, streamStart.data(), streamStart.length()))
+			{
+				streamDecoder = decoders[decoder];
+			}
+			streamOffered = true;
+			break;
+		}
+	}
+	if (streamOffered || (streamStart.length() >= 512))
+	{
+		streamOffered = true;
+		streamStart.clear();
+	}
+}
+
+/*
+ * Appends the decimal form of 'value' to 'output' without a temporary string.
+ */
+void WeatherData::appendInt(std::string& output, int value)
+{
+	char digits[12];
+	size_t pos = sizeof(digits);
+	unsigned int magnitude = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+	do
+	{
+		digits[--pos] = '0' + (magnitude % 10);
+		magnitude /= 10;
+	}
+	while (magnitude != 0);
+	if (value < 0)
+	{
+		digits[--pos] = '-';
+	}
+	output.append(digits + pos, sizeof(digits) - pos);
 }
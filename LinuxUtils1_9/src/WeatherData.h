@@ -3,36 +3,110 @@
 
 #include <string>
 #include <pthread.h>
-#include "XMLParser.h"
+#include <time.h>
+#include <vector>
+#include "ForecastDecoder.h"
+#include "ForecastHistory.h"
+#include "HTTPClient.h"
 
-class WeatherData
+class WeatherData: public HTTPBodyListener
 {
 	public:
 		WeatherData();
 		virtual ~WeatherData();
-		void updateWeatherData(std::string weatherXML);
+		bool updateWeatherData(std::string weatherXML);
+		bool refreshWeatherData(std::string weatherXML);
+		bool isFetching();
 		void forecastToTerminal();
+		void historyToTerminal();
 		bool isDataValid();
-		struct FORECAST
+		bool isDataFresh();
+		bool lastFetchSucceeded();
+		typedef ForecastDecoder::FORECAST FORECAST;
+		void addDecoder(ForecastDecoder* decoder);
+		/*
+		 * A complete forecast as published by the fetch thread. Never
+		 * changed once published; 'generation' counts successful fetches,
+		 * so 0 means no data yet.
+		 */
+		struct SNAPSHOT
 		{
-				std::string day;
-				std::string description;
-				int maxTemp; // Celsius
-				int minTemp; // Celsius
-				std::string windDirection;
-				int windSpeed; // mph
+				FORECAST day[3];
+				unsigned int generation;
 		};
-		FORECAST day[3];
+		const SNAPSHOT* acquireSnapshot();
+		void releaseSnapshot();
+		struct FETCH_STATS
+		{
+				unsigned long issued; // fetches started
+				unsigned long skipped; // refresh calls that started nothing
+				unsigned long failed; // fetches that ended without a forecast
+		};
+		FETCH_STATS getFetchStats();
+		struct FETCH_TIMING
+		{
+				double resolve; // milliseconds
+				double connect;
+				double transfer;
+				double parse;
+		};
+		bool waitForFetch(int timeoutMilliseconds);
+		void setFetchTimeout(int milliseconds);
+		FETCH_TIMING getLastFetchTiming();
+		ForecastHistory* getHistory();
+		time_t getLastUpdated();
+		virtual void bodyBegin(const HTTPClient::Response& response);
+		virtual void bodyData(const char* data, size_t length);
 	private:
-		bool parseXML(std::string xmlData);
-		std::string getParameter(std::string, std::string, std::string);
-		std::string intToString(int value);
+		enum
+		{
+			FETCH_NONE, FETCH_OK, FETCH_FAILED
+		};
+		bool parseFeed(const std::string& body, const std::string& contentType, FORECAST* day);
+		void appendInt(std::string& output, int value);
 		static void* start_thread(void *obj);
 		void getDataThread();
+		void publishSnapshot(SNAPSHOT* fresh);
+		bool startFetch(const std::string& XML);
+		void collectFetchResult();
+		long long monotonicMilliseconds();
+		int defaultRouteCount();
+		std::string cacheFilePath(const std::string& url);
+		std::string historyFilePath(const std::string& url);
+		void loadCache(const std::string& url);
+		void saveCache(const std::string& url, const SNAPSHOT& snapshot, const std::string& body);
+		std::string cacheField(const std::string& text);
 		pthread_t threadMethod;
+		bool threadStarted;
+		int fetchRunning; // 1 while the fetch thread is working
+		int fetchResult; // outcome of the last fetch, until collected
+		pthread_mutex_t fetchLock;
+		pthread_cond_t fetchDone; // signalled when a fetch finishes
+		FETCH_TIMING lastTiming;
+		FETCH_STATS fetchStats;
+		int fetchTimeout; // milliseconds allowed for each fetch, DNS lookup included
+		unsigned int jitterSeed; // rand_r state for the backoff jitter
+		long long nextFetchDue; // monotonic milliseconds
+		int consecutiveFailures;
+		bool lastFetchOK; // outcome of the last collected fetch
+		long long lastRouteCheck;
+		int lastRouteCount;
 		std::string weatherXML;
-		bool dataGrabbed;
-		XMLParser* xmlParser;
+		std::string cacheURL; // feed the cache fields below belong to
+		std::string cacheETag;
+		std::string cacheLastModified;
+		time_t cacheTime; // when the cached forecast was last confirmed, or 0
+		SNAPSHOT* currentSnapshot; // swapped atomically by the fetch thread
+		int activeReaders; // callers between acquire and release
+		std::vector<SNAPSHOT*> retiredSnapshots; // replaced, freed once no reader can hold them
+		HTTPClient* httpClient;
+		std::vector<ForecastDecoder*> decoders; // tried in order
+		ForecastDecoder* streamDecoder; // decoding the body still arriving, or NULL
+		bool streamOffered; // the decoders have had their chance at the start of the body
+		std::string streamStart; // start of the body, until a decoder takes it
+		bool streamWanted; // a 200 response, so the body may be a forecast
+		std::string streamContentType;
+		ForecastHistory* history; // every forecast fetched for the current feed
 };
 
 #endif /* WEATHERDATA_H_ */
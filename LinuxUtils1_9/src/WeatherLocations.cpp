@@ -0,0 +1,406 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "WeatherLocations.h"
+#include "WeatherData.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+WeatherLocations::WeatherLocations(unsigned int maxParallel)
+{
+	parallelLimit = (maxParallel != 0) ? maxParallel : 1;
+}
+
+WeatherLocations::~WeatherLocations()
+{
+	for (size_t location = 0; location < sites.size(); location++)
+	{
+		delete sites[location];
+	}
+}
+
+void WeatherLocations::addLocation(const std::string& name, const std::string& feedURL)
+{
+	sites.push_back(new WeatherData());
+	feeds.push_back(feedURL);
+	fetched.push_back(false);
+	table.locationName.push_back(name);
+	table.generation.push_back(0);
+	table.day.resize(sites.size() * 3);
+	table.description.resize(sites.size() * 3);
+	table.maxTemp.resize(sites.size() * 3, 0);
+	table.minTemp.resize(sites.size() * 3, 0);
+	table.windDirection.resize(sites.size() * 3);
+	table.windSpeed.resize(sites.size() * 3, 0);
+}
+
+size_t WeatherLocations::getLocationCount()
+{
+	return sites.size();
+}
+
+WeatherData* WeatherLocations::getLocation(size_t location)
+{
+	return sites[location];
+}
+
+/*
+ * Fetches every location that has no forecast yet, keeping up to the
+ * parallel limit in flight, and blocks until they are done or
+ * 'timeoutMilliseconds' pass. Each fetch is given only the time left, so
+ * none outlives the call by more than a moment. A fetch still running
+ * from an earlier call is waited for rather than started again. A
+ * location whose fetch finishes makes room for the next straight away,
+ * whichever order they finish in. Locations fetched successfully by an
+ * earlier call are skipped, but not those showing only a stale cached
+ * forecast. Returns how many locations are up to date: fetched, or with
+ * a cached forecast still too fresh to need fetching.
+ */
+size_t WeatherLocations::fetchAll(int timeoutMilliseconds)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long deadline = (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeoutMilliseconds;
+	std::vector<size_t> inFlight;
+	std::vector<bool> startedNow(sites.size(), false);
+	size_t next = 0;
+	while ((next < sites.size()) || (!inFlight.empty()))
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long remaining = deadline - ((long long) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+		if (remaining <= 0)
+		{
+			break;
+		}
+		while ((inFlight.size() < parallelLimit) && (next < sites.size()))
+		{
+			if (!fetched[next])
+			{
+				if (sites[next]->isFetching())
+				{
+					inFlight.push_back(next); // left over from an earlier call; started again once it ends
+				}
+				else if (startFetch(next, remaining))
+				{
+					startedNow[next] = true;
+					inFlight.push_back(next);
+				}
+			}
+			next++;
+		}
+		if (inFlight.empty())
+		{
+			break;
+		}
+		// sleep briefly on one fetch, then reap every one that has finished
+		sites[inFlight.front()]->waitForFetch((int) std::min(remaining, 10LL));
+		for (size_t slot = inFlight.size(); slot-- > 0;)
+		{
+			size_t location = inFlight[slot];
+			if (!sites[location]->isFetching())
+			{
+				fetched[location] = sites[location]->lastFetchSucceeded();
+				if (!startedNow[location] && !fetched[location] && startFetch(location, remaining))
+				{
+					startedNow[location] = true;
+					continue;
+				}
+				inFlight.erase(inFlight.begin() + slot);
+			}
+		}
+	}
+	size_t upToDate = 0;
+	for (size_t location = 0; location < sites.size(); location++)
+	{
+		if (fetched[location] || sites[location]->isDataFresh())
+		{
+			upToDate++;
+		}
+	}
+	return upToDate;
+}
+
+/*
+ * Starts a fetch for 'location' that has to finish within 'remaining'
+ * milliseconds.
+ */
+bool WeatherLocations::startFetch(size_t location, long long remaining)
+{
+	sites[location]->setFetchTimeout((int) remaining);
+	return sites[location]->updateWeatherData(feeds[location]);
+}
+
+bool WeatherLocations::wasFetched(size_t location)
+{
+	return fetched[location];
+}
+
+/*
+ * Non-blocking; call every frame. Gives each location the chance to
+ * start a scheduled refresh while fewer than the parallel limit are
+ * already fetching.
+ */
+void WeatherLocations::refresh()
+{
+	unsigned int running = 0;
+	for (size_t location = 0; location < sites.size(); location++)
+	{
+		if (sites[location]->isFetching())
+		{
+			running++;
+		}
+	}
+	for (size_t location = 0; (location < sites.size()) && (running < parallelLimit); location++)
+	{
+		if ((!sites[location]->isFetching()) && (sites[location]->refreshWeatherData(feeds[location])))
+		{
+			running++;
+		}
+	}
+}
+
+/*
+ * Brings the table up to date with the latest published forecasts.
+ * Only locations whose forecast has changed are copied.
+ */
+const WeatherLocations::FORECAST_TABLE& WeatherLocations::getTable()
+{
+	for (size_t location = 0; location < sites.size(); location++)
+	{
+		const WeatherData::SNAPSHOT* snapshot = sites[location]->acquireSnapshot();
+		if (snapshot->generation != table.generation[location])
+		{
+			for (int thisDay = 0; thisDay < 3; thisDay++)
+			{
+				size_t row = location * 3 + thisDay;
+				const WeatherData::FORECAST& forecast = snapshot->day[thisDay];
+				table.day[row] = forecast.day;
+				table.description[row] = forecast.description;
+				table.maxTemp[row] = forecast.maxTemp;
+				table.minTemp[row] = forecast.minTemp;
+				table.windDirection[row] = forecast.windDirection;
+				table.windSpeed[row] = forecast.windSpeed;
+			}
+			table.generation[location] = snapshot->generation;
+		}
+		sites[location]->releaseSnapshot();
+	}
+	return table;
+}
+
+void WeatherLocations::forecastToTerminal()
+{
+	writeForecast(STDOUT_FILENO, FORECAST_TEXT);
+}
+
+/*
+ * Writes every location's forecast to 'fileDescriptor' as readable text,
+ * or for scripts as a JSON document or CSV/TSV rows under a header line.
+ * Locations with no forecast are listed in JSON with no days, and left
+ * out of CSV/TSV. 'fetched' says whether a fetchAll() got the forecast
+ * from the network, and 'updated' when the feed last confirmed it. Built
+ * in one buffer sized up front, so it goes out in a single write().
+ * Returns false if the write fails.
+ */
+bool WeatherLocations::writeForecast(int fileDescriptor, ForecastFormat format)
+{
+	static const char* const columns[] =
+	{ "location", "fetched", "updated", "day", "dayName", "description", "maxTempC", "minTempC",
+			"windDirection", "windSpeedMph" };
+	const size_t columnCount = sizeof(columns) / sizeof(columns[0]);
+	const char* separator = (format == FORECAST_TSV) ? "\t" : ",";
+	const FORECAST_TABLE& forecasts = getTable();
+	XMLOutputSink sink(fileDescriptor);
+	sink.reserve(estimateOutputSize(forecasts, format));
+	if ((format == FORECAST_CSV) || (format == FORECAST_TSV))
+	{
+		for (size_t column = 0; column < columnCount; column++)
+		{
+			sink.append((column == 0) ? "" : separator);
+			sink.append(columns[column]);
+		}
+		sink.append("\n");
+	}
+	else if (format == FORECAST_JSON)
+	{
+		sink.append("{\"locations\":[");
+	}
+	for (size_t location = 0; location < forecasts.locationName.size(); location++)
+	{
+		bool available = (forecasts.generation[location] != 0);
+		long updated = (long) sites[location]->getLastUpdated();
+		if (format == FORECAST_TEXT)
+		{
+			if (forecasts.locationName.size() > 1)
+			{
+				sink.append("== ");
+				sink.append(forecasts.locationName[location]);
+				sink.append(" ==\n\n");
+			}
+			if (!available)
+			{
+				sink.append("No forecast available.\n\n");
+			}
+		}
+		else if (format == FORECAST_JSON)
+		{
+			sink.append((location == 0) ? "{\"location\":" : ",{\"location\":");
+			sink.appendJSONString(forecasts.locationName[location]);
+			sink.append(fetched[location] ? ",\"fetched\":true,\"updated\":" : ",\"fetched\":false,\"updated\":");
+			sink.appendSigned(updated);
+			sink.append(",\"days\":[");
+		}
+		for (int thisDay = 0; (thisDay < 3) && available; thisDay++)
+		{
+			size_t row = location * 3 + thisDay;
+			if (format == FORECAST_TEXT)
+			{
+				sink.append(forecasts.day[row]);
+				sink.append("\nOverview: ");
+				sink.append(forecasts.description[row]);
+				sink.append("\nMax Temp: ");
+				sink.appendSigned(forecasts.maxTemp[row]);
+				sink.append(" C\nMin Temp: ");
+				sink.appendSigned(forecasts.minTemp[row]);
+				sink.append(" C\nWind Direction: ");
+				sink.append(forecasts.windDirection[row]);
+				sink.append("\nWind Speed: ");
+				sink.appendSigned(forecasts.windSpeed[row]);
+				sink.append(" mph\n\n");
+			}
+			else if (format == FORECAST_JSON)
+			{
+				sink.append((thisDay == 0) ? "{\"day\":" : ",{\"day\":");
+				sink.appendSigned(thisDay);
+				sink.append(",\"dayName\":");
+				sink.appendJSONString(forecasts.day[row]);
+				sink.append(",\"description\":");
+				sink.appendJSONString(forecasts.description[row]);
+				sink.append(",\"maxTempC\":");
+				sink.appendSigned(forecasts.maxTemp[row]);
+				sink.append(",\"minTempC\":");
+				sink.appendSigned(forecasts.minTemp[row]);
+				sink.append(",\"windDirection\":");
+				sink.appendJSONString(forecasts.windDirection[row]);
+				sink.append(",\"windSpeedMph\":");
+				sink.appendSigned(forecasts.windSpeed[row]);
+				sink.append("}");
+			}
+			else
+			{
+				appendField(sink, format, forecasts.locationName[location]);
+				sink.append(separator);
+				sink.append(fetched[location] ? "1" : "0");
+				sink.append(separator);
+				sink.appendSigned(updated);
+				sink.append(separator);
+				sink.appendSigned(thisDay);
+				sink.append(separator);
+				appendField(sink, format, forecasts.day[row]);
+				sink.append(separator);
+				appendField(sink, format, forecasts.description[row]);
+				sink.append(separator);
+				sink.appendSigned(forecasts.maxTemp[row]);
+				sink.append(separator);
+				sink.appendSigned(forecasts.minTemp[row]);
+				sink.append(separator);
+				appendField(sink, format, forecasts.windDirection[row]);
+				sink.append(separator);
+				sink.appendSigned(forecasts.windSpeed[row]);
+				sink.append("\n");
+			}
+		}
+		if (format == FORECAST_JSON)
+		{
+			sink.append("]}");
+		}
+	}
+	if (format == FORECAST_JSON)
+	{
+		sink.append("]}\n");
+	}
+	return sink.flush();
+}
+
+/*
+ * An upper bound on the output of writeForecast in 'format', so the sink
+ * never has to grow part way through. Each text byte is counted at its
+ * worst case: six for a JSON "\u00XX" escape, two for a doubled CSV
+ * quote, plus the quotes around the field. The CSV and TSV rows repeat
+ * the location name for every day.
+ */
+size_t WeatherLocations::estimateOutputSize(const FORECAST_TABLE& forecasts, ForecastFormat format)
+{
+	size_t escaped = (format == FORECAST_JSON) ? 6 : (format == FORECAST_CSV) ? 2 : 1;
+	size_t nameCopies = ((format == FORECAST_CSV) || (format == FORECAST_TSV)) ? 3 : 1;
+	size_t size = 256;
+	for (size_t location = 0; location < forecasts.locationName.size(); location++)
+	{
+		size += 128 + nameCopies * (escaped * forecasts.locationName[location].length() + 2);
+		for (int thisDay = 0; thisDay < 3; thisDay++)
+		{
+			size_t row = location * 3 + thisDay;
+			size += 256 + escaped * (forecasts.day[row].length() + forecasts.description[row].length()
+					+ forecasts.windDirection[row].length()) + 3 * 2;
+		}
+	}
+	return size;
+}
+
+/*
+ * A CSV field is quoted when it holds a comma, quote or line break, with
+ * quotes doubled. TSV has no quoting, so tabs and line breaks become
+ * spaces.
+ */
+void WeatherLocations::appendField(XMLOutputSink& sink, ForecastFormat format, XMLSpan text)
+{
+	if (format == FORECAST_TSV)
+	{
+		size_t runStart = 0;
+		for (size_t pos = 0; pos < text.length; pos++)
+		{
+			if ((text.data[pos] == '\t') || (text.data[pos] == '\n') || (text.data[pos] == '\r'))
+			{
+				sink.append(text.substr(runStart, pos - runStart));
+				sink.append(" ");
+				runStart = pos + 1;
+			}
+		}
+		sink.append(text.substr(runStart));
+		return;
+	}
+	if (text.findFirstOf(",\"\r\n") == XMLSpan::npos)
+	{
+		sink.append(text);
+		return;
+	}
+	sink.append("\"");
+	size_t runStart = 0;
+	for (size_t pos = 0; pos < text.length; pos++)
+	{
+		if (text.data[pos] == '"')
+		{
+			sink.append(text.substr(runStart, pos + 1 - runStart));
+			sink.append("\"");
+			runStart = pos + 1;
+		}
+	}
+	sink.append(text.substr(runStart));
+	sink.append("\"");
+}
@@ -0,0 +1,59 @@
+#ifndef WEATHERLOCATIONS_H_
+#define WEATHERLOCATIONS_H_
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "WeatherData.h"
+#include "XMLOutputSink.h"
+#include "XMLSpan.h"
+
+/*
+ * Forecasts for several locations, one WeatherData (and fetch thread)
+ * each, with no more than 'maxParallel' fetches in flight at once.
+ */
+class WeatherLocations
+{
+	public:
+		/*
+		 * Every location's forecast in one structure of arrays. Per day
+		 * fields are indexed by location * 3 + day.
+		 */
+		struct FORECAST_TABLE
+		{
+				std::vector<std::string> locationName;
+				std::vector<unsigned int> generation; // per location; 0 if no data
+				std::vector<std::string> day;
+				std::vector<std::string> description;
+				std::vector<int> maxTemp; // Celsius
+				std::vector<int> minTemp; // Celsius
+				std::vector<std::string> windDirection;
+				std::vector<int> windSpeed; // mph
+		};
+		enum ForecastFormat
+		{
+			FORECAST_TEXT, FORECAST_JSON, FORECAST_CSV, FORECAST_TSV
+		};
+		WeatherLocations(unsigned int maxParallel = 4);
+		virtual ~WeatherLocations();
+		void addLocation(const std::string& name, const std::string& feedURL);
+		size_t getLocationCount();
+		WeatherData* getLocation(size_t location);
+		size_t fetchAll(int timeoutMilliseconds);
+		bool wasFetched(size_t location);
+		void refresh();
+		const FORECAST_TABLE& getTable();
+		void forecastToTerminal();
+		bool writeForecast(int fileDescriptor, ForecastFormat format);
+	private:
+		unsigned int parallelLimit;
+		std::vector<WeatherData*> sites;
+		std::vector<std::string> feeds;
+		std::vector<bool> fetched; // a fetchAll has fetched its forecast successfully
+		FORECAST_TABLE table;
+		bool startFetch(size_t location, long long remaining);
+		size_t estimateOutputSize(const FORECAST_TABLE& forecasts, ForecastFormat format);
+		void appendField(XMLOutputSink& sink, ForecastFormat format, XMLSpan text);
+};
+
+#endif /* WEATHERLOCATIONS_H_ */
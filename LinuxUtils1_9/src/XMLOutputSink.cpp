@@ -0,0 +1,160 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "XMLOutputSink.h"
+#include <string>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+static const char SPACES[] = "                                                                "; // 64
+
+XMLOutputSink::XMLOutputSink(int fileDescriptor)
+{
+	descriptor = fileDescriptor;
+	targetString = NULL;
+	writeFailed = false;
+	bufferLimit = BUFFER_SIZE;
+	buffer.reserve(BUFFER_SIZE);
+	// anything already sitting in stdio has to come out first
+	fflush(stdout);
+}
+
+XMLOutputSink::XMLOutputSink(std::string* target)
+{
+	descriptor = -1;
+	targetString = target;
+	writeFailed = false;
+	bufferLimit = BUFFER_SIZE;
+}
+
+XMLOutputSink::~XMLOutputSink()
+{
+	flush();
+}
+
+void XMLOutputSink::append(XMLSpan text)
+{
+	if (targetString != NULL)
+	{
+		targetString->append(text.data, text.length);
+		return;
+	}
+	if (buffer.length() + text.length > bufferLimit)
+	{
+		flush();
+	}
+	buffer.append(text.data, text.length);
+}
+
+/*
+ * Appends 'width' spaces, copied from a preset run rather than one by one.
+ */
+void XMLOutputSink::appendIndent(size_t width)
+{
+	while (width > 0)
+	{
+		size_t run = width < sizeof(SPACES) - 1 ? width : sizeof(SPACES) - 1;
+		append(XMLSpan(SPACES, run));
+		width -= run;
+	}
+}
+
+void XMLOutputSink::appendNumber(size_t value)
+{
+	char digits[24];
+	int length = snprintf(digits, sizeof(digits), "%lu", (unsigned long) value);
+	append(XMLSpan(digits, length));
+}
+
+void XMLOutputSink::appendSigned(long value)
+{
+	char digits[24];
+	int length = snprintf(digits, sizeof(digits), "%ld", value);
+	append(XMLSpan(digits, length));
+}
+
+/*
+ * Appends 'text' as a quoted JSON string.
+ */
+void XMLOutputSink::appendJSONString(XMLSpan text)
+{
+	append("\"");
+	size_t runStart = 0;
+	for (size_t pos = 0; pos < text.length; pos++)
+	{
+		unsigned char character = (unsigned char) text.data[pos];
+		if ((character >= 0x20) && (character != '"') && (character != '\\'))
+		{
+			continue;
+		}
+		append(text.substr(runStart, pos - runStart));
+		char escaped[8];
+		if ((character == '"') || (character == '\\'))
+		{
+			snprintf(escaped, sizeof(escaped), "\\%c", character);
+		}
+		else
+		{
+			snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+		}
+		append(escaped);
+		runStart = pos + 1;
+	}
+	append(text.substr(runStart));
+	append("\"");
+}
+
+/*
+ * Makes room for at least 'bytes' more output before anything has to be
+ * written, so output of a known size goes out in a single write().
+ */
+void XMLOutputSink::reserve(size_t bytes)
+{
+	if (targetString != NULL)
+	{
+		targetString->reserve(targetString->length() + bytes);
+		return;
+	}
+	if (buffer.length() + bytes > bufferLimit)
+	{
+		bufferLimit = buffer.length() + bytes;
+		buffer.reserve(bufferLimit);
+	}
+}
+
+/*
+ * Writes out anything buffered. Returns false if a write has failed;
+ * output after a failed write is dropped.
+ */
+bool XMLOutputSink::flush()
+{
+	size_t written = 0;
+	while ((!writeFailed) && (written < buffer.length()))
+	{
+		ssize_t result = write(descriptor, buffer.data() + written, buffer.length() - written);
+		if (result < 0)
+		{
+			if (errno != EINTR)
+			{
+				writeFailed = true;
+			}
+			continue;
+		}
+		written += result;
+	}
+	buffer.clear();
+	return !writeFailed;
+}
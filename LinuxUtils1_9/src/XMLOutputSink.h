@@ -0,0 +1,36 @@
+#ifndef XMLOUTPUTSINK_H_
+#define XMLOUTPUTSINK_H_
+
+#include <string>
+#include <stddef.h>
+#include "XMLSpan.h"
+
+/*
+ * Collects output in a large buffer and hands it over in few calls:
+ * either write(2) to a file descriptor whenever the buffer fills, or
+ * appended straight onto a caller's std::string. Anything still
+ * buffered is flushed when the sink is destroyed.
+ */
+class XMLOutputSink
+{
+	public:
+		XMLOutputSink(int fileDescriptor);
+		XMLOutputSink(std::string* target);
+		virtual ~XMLOutputSink();
+		void append(XMLSpan text);
+		void appendIndent(size_t width);
+		void appendNumber(size_t value);
+		void appendSigned(long value);
+		void appendJSONString(XMLSpan text);
+		void reserve(size_t bytes);
+		bool flush();
+	private:
+		static const size_t BUFFER_SIZE = 1 << 16;
+		int descriptor;
+		std::string* targetString;
+		std::string buffer;
+		size_t bufferLimit; // written out once it would grow past this
+		bool writeFailed;
+};
+
+#endif /* XMLOUTPUTSINK_H_ */
@@ -17,19 +17,84 @@
 #include <string>
 #include <fstream>
 #include <stack>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include "XMLScanner.h"
+#include "XMLQuery.h"
+#include "XMLOutputSink.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+const unsigned int XMLParser::NO_SYMBOL;
 
 XMLParser::XMLParser()
 {
+	sourceData = xmlContents.data();
+	sourceLength = 0;
+	markupScanned = false;
+	mappedData = NULL;
+	mappedLength = 0;
 }
 
 XMLParser::~XMLParser()
 {
+	releaseMapping();
 }
 
-bool XMLParser::setSource(std::string xmlText)
+/*
+ * Orders index entries by tag name, then by position in the document.
+ */
+struct XMLParser::TagOrder
 {
+		const char* base;
+		bool operator()(const TagEntry& a, const TagEntry& b) const
+		{
+			size_t common = a.nameLength < b.nameLength ? a.nameLength : b.nameLength;
+			int diff = memcmp(base + a.nameStart, base + b.nameStart, common);
+			if (diff != 0)
+			{
+				return diff < 0;
+			}
+			if (a.nameLength != b.nameLength)
+			{
+				return a.nameLength < b.nameLength;
+			}
+			return a.valueStart < b.valueStart;
+		}
+};
+
+bool XMLParser::setSource(const std::string& xmlText)
+{
+	releaseMapping();
 	xmlContents = xmlText;
-	if (xmlContents.length() == 0)
+	sourceData = xmlContents.data();
+	sourceLength = xmlContents.length();
+	buildIndex();
+	if (sourceLength == 0)
+	{
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Parses the caller's buffer in place rather than taking a copy.
+ * The buffer must stay untouched for as long as this source is in use,
+ * as spans returned by the parser point straight into it.
+ */
+bool XMLParser::setSource(const char* xmlText, size_t length)
+{
+	releaseMapping();
+	xmlContents.clear();
+	sourceData = xmlText;
+	sourceLength = length;
+	buildIndex();
+	if (sourceLength == 0)
 	{
 		return false;
 	}
@@ -38,6 +103,7 @@ bool XMLParser::setSource(std::string xmlText)
 
 bool XMLParser::setSource(std::ifstream* xmlFile)
 {
+	releaseMapping();
 	xmlContents = "";
 	std::string textLine = "";
 	if (xmlFile->is_open())
@@ -49,78 +115,354 @@ bool XMLParser::setSource(std::ifstream* xmlFile)
 		}
 		xmlFile->close();
 	}
-	else
+	sourceData = xmlContents.data();
+	sourceLength = xmlContents.length();
+	buildIndex();
+	if (sourceLength == 0)
 	{
-		return false; // error loading file
+		return false;
 	}
-	if (xmlContents.length() == 0)
+	return true;
+}
+
+/*
+ * Maps the file at 'path' read-only and parses it in place, so large
+ * exports are never copied onto the heap. The mapping is held until the
+ * next setSource call or until the parser is destroyed.
+ * Returns false if the file cannot be opened or is empty.
+ */
+bool XMLParser::setSourceFile(const std::string& path)
+{
+	releaseMapping();
+	xmlContents.clear();
+	sourceData = xmlContents.data();
+	sourceLength = 0;
+	int fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor != -1)
+	{
+		struct stat fileInfo;
+		if ((fstat(fileDescriptor, &fileInfo) == 0) && (fileInfo.st_size > 0)
+				&& ((unsigned long long) fileInfo.st_size <= (size_t) -1))
+		{
+			void* mapping = mmap(NULL, (size_t) fileInfo.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+			if (mapping != MAP_FAILED)
+			{
+				madvise(mapping, (size_t) fileInfo.st_size, MADV_SEQUENTIAL);
+				mappedData = mapping;
+				mappedLength = (size_t) fileInfo.st_size;
+				sourceData = (const char*) mapping;
+				sourceLength = mappedLength;
+			}
+		}
+		close(fileDescriptor);
+	}
+	buildIndex();
+	if (sourceLength == 0)
 	{
 		return false;
 	}
 	return true;
 }
 
+void XMLParser::releaseMapping()
+{
+	if (mappedData != NULL)
+	{
+		munmap(mappedData, mappedLength);
+		mappedData = NULL;
+		mappedLength = 0;
+	}
+}
+
+/*
+ * Single pass over the source recording every plain opening tag
+ * ("<name>", no attributes) along with the span of text that follows it,
+ * up to the next '<'. Tag lookups then become a binary search.
+ */
+void XMLParser::buildIndex()
+{
+	tagIndex.clear();
+	markupIndex.clear();
+	markupScanned = false;
+	symbolNames.clear();
+	symbolSlots.assign(symbolSlots.size(), NO_SYMBOL);
+	const char* base = sourceData;
+	size_t length = sourceLength;
+	const char* cursor = (const char*) memchr(base, '<', length);
+	while (cursor != NULL)
+	{
+		size_t tagStart = cursor - base;
+		size_t nameEnd = tagStart + 1;
+		while ((nameEnd < length) && (strchr("<>/ \t\r\n", base[nameEnd]) == NULL))
+		{
+			nameEnd++;
+		}
+		size_t valueStart = nameEnd + 1;
+		cursor = NULL;
+		if (valueStart <= length)
+		{
+			cursor = (const char*) memchr(base + valueStart, '<', length - valueStart);
+		}
+		if ((nameEnd < length) && (base[nameEnd] == '>') && (nameEnd > tagStart + 1))
+		{
+			TagEntry entry;
+			entry.nameStart = tagStart + 1;
+			entry.nameLength = nameEnd - entry.nameStart;
+			entry.valueStart = valueStart;
+			entry.valueEnd = (cursor != NULL) ? (size_t) (cursor - base) : length;
+			tagIndex.push_back(entry);
+		}
+		else if (nameEnd < length && base[nameEnd] == '<')
+		{
+			// stray '<' inside a tag name, rescan from the new one
+			cursor = base + nameEnd;
+		}
+	}
+	TagOrder order;
+	order.base = base;
+	std::sort(tagIndex.begin(), tagIndex.end(), order);
+}
+
+/*
+ * Locates the run of index entries for 'xmlTag'.
+ * Returns false if the tag does not appear in the source.
+ */
+bool XMLParser::findTag(XMLSpan xmlTag, size_t& first, size_t& count)
+{
+	size_t low = 0;
+	size_t high = tagIndex.size();
+	// lower bound on name
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		const TagEntry& entry = tagIndex[mid];
+		size_t common = entry.nameLength < xmlTag.length ? entry.nameLength : xmlTag.length;
+		int diff = memcmp(sourceData + entry.nameStart, xmlTag.data, common);
+		if ((diff < 0) || ((diff == 0) && (entry.nameLength < xmlTag.length)))
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	first = low;
+	count = 0;
+	while ((low < tagIndex.size()) && (tagIndex[low].nameLength == xmlTag.length) && (memcmp(sourceData
+			+ tagIndex[low].nameStart, xmlTag.data, xmlTag.length) == 0))
+	{
+		low++;
+		count++;
+	}
+	return count != 0;
+}
+
 /*
  * This function grabs the contents of the 'nth' XML tag.
  * If no value given for 'nth', the first occurrence will be returned.
  * Returns an empty string if not found, or if no source has been set.
  *
  */
-std::string XMLParser::getTagValue(std::string xmlTag, unsigned int nth)
+std::string XMLParser::getTagValue(XMLSpan xmlTag, unsigned int nth)
 {
-	std::string tagValue = "";
-	std::string openTag = "<" + xmlTag + ">";
-	if (xmlContents.length() == 0)
+	return getTagSpan(xmlTag, nth).str();
+}
+
+/*
+ * As getTagValue, but returns a span into the source buffer instead of
+ * a copy. The span is empty if the tag is not found.
+ */
+XMLSpan XMLParser::getTagSpan(XMLSpan xmlTag, unsigned int nth)
+{
+	size_t first, count;
+	if ((nth == 0) || (!findTag(xmlTag, first, count)) || (nth > count))
+	{
+		return XMLSpan();
+	}
+	const TagEntry& entry = tagIndex[first + nth - 1];
+	return XMLSpan(sourceData + entry.valueStart, entry.valueEnd - entry.valueStart);
+}
+
+int XMLParser::getTagCount(XMLSpan xmlTag)
+{
+	size_t first, count;
+	findTag(xmlTag, first, count);
+	return count;
+}
+
+/*
+ * An element on the path from the root to the current tag, used by
+ * runQueries. 'childCounts' is where this element's entries begin in
+ * the list of sibling counts.
+ */
+struct XMLParser::QueryElement
+{
+		XMLSpan name;
+		unsigned int position;
+		size_t childCounts;
+};
+
+/*
+ * How many children of a given name an open element has had so far.
+ */
+struct XMLParser::QuerySibling
+{
+		XMLSpan name;
+		unsigned int count;
+};
+
+/*
+ * Evaluates every query in 'queries' in a single walk of the source,
+ * replacing any matches from an earlier run. Returns the total number
+ * of matches found.
+ */
+size_t XMLParser::runQueries(std::vector<XMLQuery*>& queries)
+{
+	size_t total = 0;
+	for (size_t query = 0; query < queries.size(); query++)
 	{
-		return "";
+		queries[query]->matches.clear();
 	}
-	unsigned int cursorLocA = 0;
-	unsigned int cursorLocB = 0;
-	for (int thisTag = nth; thisTag > 0; thisTag--)
+	std::vector<QueryElement> path;
+	std::vector<QuerySibling> siblings;
+	size_t boundary = 0;
+	XMLSpan currentTag;
+	while (nextTag(boundary, currentTag))
 	{
-		cursorLocA = xmlContents.find(&openTag[0], cursorLocA, (2 + xmlTag.length()));
-		if (thisTag != 1)
+		if (isDeclaration(currentTag))
 		{
-			cursorLocA++;
+			continue;
+		}
+		if (isClosing(currentTag))
+		{
+			if (!path.empty())
+			{
+				siblings.resize(path.back().childCounts);
+				path.pop_back();
+			}
+			continue;
+		}
+		QueryElement element;
+		element.name = elementName(currentTag);
+		element.position = 0;
+		size_t firstSibling = path.empty() ? 0 : path.back().childCounts;
+		for (size_t sibling = firstSibling; sibling < siblings.size(); sibling++)
+		{
+			if (siblings[sibling].name == element.name)
+			{
+				element.position = ++siblings[sibling].count;
+				break;
+			}
+		}
+		if (element.position == 0)
+		{
+			QuerySibling sibling;
+			sibling.name = element.name;
+			sibling.count = 1;
+			siblings.push_back(sibling);
+			element.position = 1;
+		}
+		element.childCounts = siblings.size();
+		path.push_back(element);
+		for (size_t query = 0; query < queries.size(); query++)
+		{
+			XMLQuery* current = queries[query];
+			if ((!current->valid) || (current->steps.size() != path.size()))
+			{
+				continue;
+			}
+			size_t level = 0;
+			while ((level < path.size()) && (path[level].name == XMLSpan(current->steps[level].name))
+					&& ((current->steps[level].position == 0) || (current->steps[level].position
+							== path[level].position)))
+			{
+				level++;
+			}
+			if (level == path.size())
+			{
+				// value runs from the end of the tag up to the next one
+				size_t valueStart = (currentTag.data - sourceData) + currentTag.length;
+				const char* valueEnd = (const char*) memchr(sourceData + valueStart, '<', sourceLength - valueStart);
+				size_t valueLength = (valueEnd != NULL) ? (size_t) (valueEnd - sourceData) - valueStart
+						: sourceLength - valueStart;
+				current->matches.push_back(XMLSpan(sourceData + valueStart, valueLength));
+				total++;
+			}
+		}
+		if (isSelfClosing(currentTag))
+		{
+			siblings.resize(path.back().childCounts);
+			path.pop_back();
 		}
 	}
-	if (cursorLocA == std::string::npos)
+	return total;
+}
+
+/*
+ * The element name of a tag: everything after the '<' or '</' up to
+ * whitespace, '/' or '>', so attributes are left off.
+ */
+XMLSpan XMLParser::elementName(const XMLSpan& tag)
+{
+	size_t start = isClosing(tag) ? 2 : 1;
+	size_t end = start;
+	while ((end < tag.length) && (strchr(" \t\r\n/>", tag.data[end]) == NULL))
 	{
-		// failed to find closing tag, reached EOF
-		return "";
+		end++;
 	}
-	cursorLocA = cursorLocA + (2 + xmlTag.length()); // got start of data
-	// Find closing tag, or another opening tag position...
-	cursorLocB = xmlContents.find("<", cursorLocA, 1);
+	return tag.substr(start, end - start);
+}
 
-	try
+/*
+ * Returns the symbol for 'name', adding it to the table if this is its
+ * first appearance in the document. Symbols are indexes into symbolNames,
+ * looked up through an open addressed hash table of those indexes.
+ */
+unsigned int XMLParser::internName(XMLSpan name)
+{
+	if ((symbolNames.size() + 1) * 2 > symbolSlots.size())
 	{
-		tagValue = xmlContents.substr(cursorLocA, cursorLocB - cursorLocA);
+		// keep the table at most half full
+		size_t slotCount = symbolSlots.empty() ? 64 : symbolSlots.size() * 2;
+		symbolSlots.assign(slotCount, NO_SYMBOL);
+		for (unsigned int symbol = 0; symbol < symbolNames.size(); symbol++)
+		{
+			size_t slot = hashName(symbolNames[symbol]) & (slotCount - 1);
+			while (symbolSlots[slot] != NO_SYMBOL)
+			{
+				slot = (slot + 1) & (slotCount - 1);
+			}
+			symbolSlots[slot] = symbol;
+		}
 	}
-	catch (std::exception exc)
+	size_t mask = symbolSlots.size() - 1;
+	size_t slot = hashName(name) & mask;
+	while (symbolSlots[slot] != NO_SYMBOL)
 	{
-		tagValue = "";
+		if (symbolNames[symbolSlots[slot]] == name)
+		{
+			return symbolSlots[slot];
+		}
+		slot = (slot + 1) & mask;
 	}
-	return tagValue;
+	symbolSlots[slot] = symbolNames.size();
+	symbolNames.push_back(name);
+	return symbolSlots[slot];
 }
 
-int XMLParser::getTagCount(std::string xmlTag)
+/*
+ * FNV-1a over the bytes of 'name'.
+ */
+size_t XMLParser::hashName(XMLSpan name)
 {
-	std::string tagToCount = "<" + xmlTag + ">";
-	unsigned int cursorPos = 0;
-	int tagCount = 0;
-	do
+	size_t hash = 2166136261u;
+	for (size_t pos = 0; pos < name.length; pos++)
 	{
-		cursorPos = xmlContents.find(&tagToCount[0], cursorPos, (2 + xmlTag.length()));
-		if (cursorPos == std::string::npos)
-		{
-			break;
-		}
-		cursorPos++;
-		tagCount++;
+		hash ^= (unsigned char) name.data[pos];
+		hash *= 16777619u;
 	}
-	while (true);
-	return tagCount;
+	return hash;
 }
 
 /*
@@ -129,154 +471,390 @@ int XMLParser::getTagCount(std::string xmlTag)
 bool XMLParser::validateXML(std::string& errorMessage)
 {
 	bool error = false;
-	if (xmlContents.length() == 0)
+	if (sourceLength == 0)
 	{
 		return 0;
 	}
-	std::stack<std::string> tagStack;
-	unsigned int cursorLocA = 0;
-	unsigned int cursorLocB = 0;
-	std::string currentTag = "";
-	do
+	std::stack<unsigned int> tagStack; // symbols of the open tags
+	size_t boundary = 0;
+	XMLSpan currentTag;
+	while ((!error) && (nextTag(boundary, currentTag)))
 	{
-		try
+		// First, carry on if tag is DTD or self closing
+		if (isDeclaration(currentTag) || isSelfClosing(currentTag))
 		{
-			cursorLocA = xmlContents.find("<", cursorLocB, 1);
-			cursorLocB = xmlContents.find(">", cursorLocA, 1);
-			if (cursorLocB == std::string::npos)
-			{
-				// end of file.
-				break;
-			}
-			currentTag = xmlContents.substr(cursorLocA, (cursorLocB - cursorLocA) + 1);
-			// First, carry on if tag is DTD or self closing
-			if ((currentTag.substr(0, 2) == "<?") || (currentTag.substr(currentTag.length() - 2, 2) == "/>"))
+			continue;
+		}
+		unsigned int symbol = internName(elementName(currentTag));
+		if (!isClosing(currentTag))
+		{
+			// open tag found
+			tagStack.push(symbol);
+		}
+		else if (tagStack.empty())
+		{
+			errorMessage = "Found " + currentTag.str() + " with no open tag.";
+			error = true;
+		}
+		else if (symbol == tagStack.top())
+		{
+			// okay, they match. Pop off opening tag
+			tagStack.pop();
+		}
+		else
+		{
+			errorMessage = "Expected closing tag for <" + symbolNames[tagStack.top()].str() + ">, but found "
+					+ currentTag.str() + ".";
+			error = true;
+		}
+	}
+	if (tagStack.size() == 0)
+	{
+		return !error; // all okay
+	}
+	if (errorMessage.length() == 0) // check no existing errors....
+	{
+		errorMessage = "<" + symbolNames[tagStack.top()].str() + "> lacks closing tag.";
+	}
+	return false; // almost okay, stack not empty though so a closing tag missing?
+}
+
+/*
+ * One slice of the source for validateXMLParallel. After the worker runs,
+ * 'closes' holds the closing tags it could not match, in order, and
+ * 'opens' the names of the tags still open at the end of the slice.
+ */
+struct XMLParser::ValidationChunk
+{
+		XMLParser* parser;
+		size_t start;
+		size_t end;
+		std::vector<XMLSpan> closes;
+		std::vector<XMLSpan> opens;
+		bool error;
+		std::string errorMessage;
+};
+
+/*
+ * Same result and messages as validateXML, but the source is split into
+ * slices that are checked on 'workerCount' threads (0 for one per CPU).
+ * Each slice is reduced to its unmatched closing and opening tags, and
+ * these are then matched up in document order. Small sources are simply
+ * passed to validateXML.
+ */
+bool XMLParser::validateXMLParallel(std::string& errorMessage, unsigned int workerCount)
+{
+	if (workerCount == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		workerCount = (cpus > 0) ? (unsigned int) cpus : 1;
+	}
+	const size_t minimumSlice = 1 << 20;
+	if ((workerCount < 2) || (sourceLength < 2 * minimumSlice))
+	{
+		return validateXML(errorMessage);
+	}
+	if (sourceLength / workerCount < minimumSlice)
+	{
+		workerCount = sourceLength / minimumSlice;
+	}
+	// Slices end just after a '>'. The serial walk is always looking for
+	// the next '<' at such a point, so each slice can be walked on its own.
+	std::vector<ValidationChunk> chunks(workerCount);
+	size_t start = 0;
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		size_t end = sourceLength;
+		if (worker + 1 < workerCount)
+		{
+			size_t target = (sourceLength / workerCount) * (worker + 1);
+			if (target < start)
 			{
-				continue;
+				target = start;
 			}
-			if ((currentTag.substr(0, 1) == "<") && (currentTag.substr(0, 2) != "</"))
+			const char* split = (const char*) memchr(sourceData + target, '>', sourceLength - target);
+			end = (split != NULL) ? (size_t) (split - sourceData) + 1 : sourceLength;
+		}
+		chunks[worker].parser = this;
+		chunks[worker].start = start;
+		chunks[worker].end = end;
+		chunks[worker].error = false;
+		start = end;
+	}
+	std::vector<pthread_t> threads(workerCount);
+	std::vector<bool> started(workerCount, false);
+	for (unsigned int worker = 1; worker < workerCount; worker++)
+	{
+		started[worker] = (pthread_create(&threads[worker], NULL, XMLParser::start_validation, &chunks[worker]) == 0);
+	}
+	validateChunk(chunks[0]);
+	for (unsigned int worker = 1; worker < workerCount; worker++)
+	{
+		if (started[worker])
+		{
+			pthread_join(threads[worker], NULL);
+		}
+		else
+		{
+			validateChunk(chunks[worker]);
+		}
+	}
+	// merge, in document order
+	std::vector<XMLSpan> tagStack;
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		ValidationChunk& chunk = chunks[worker];
+		for (size_t close = 0; close < chunk.closes.size(); close++)
+		{
+			XMLSpan currentTag = chunk.closes[close];
+			if (tagStack.empty())
 			{
-				// open tag found
-				tagStack.push(currentTag);
+				errorMessage = "Found " + currentTag.str() + " with no open tag.";
+				return false;
 			}
-			if (currentTag.substr(0, 2) == "</")
+			if (elementName(currentTag) != tagStack.back())
 			{
-				// closing tag found
-				if (currentTag.substr(2, currentTag.length() - 2) == tagStack.top().substr(1,
-						tagStack.top().length() - 1))
-				{
-					// okay, they match. Pop off opening tag
-					tagStack.pop();
-				}
-				else
-				{
-					errorMessage = "Expected closing tag for " + tagStack.top() + ", but found " + currentTag
-							+ ".";
-					error = true;
-				}
+				errorMessage = "Expected closing tag for <" + tagStack.back().str() + ">, but found "
+						+ currentTag.str() + ".";
+				return false;
 			}
+			tagStack.pop_back();
 		}
-		catch (std::exception exc)
+		if (chunk.error)
 		{
-			errorMessage = "An unknown error occurred.";
-			error = true;
+			errorMessage = chunk.errorMessage;
+			return false;
 		}
+		tagStack.insert(tagStack.end(), chunk.opens.begin(), chunk.opens.end());
 	}
-	while (!error);
 	if (tagStack.size() == 0)
 	{
 		return true; // all okay
 	}
-	if (errorMessage.length() == 0) // check no existing errors....
+	errorMessage = "<" + tagStack.back().str() + "> lacks closing tag.";
+	return false;
+}
+
+void* XMLParser::start_validation(void* obj)
+{
+	ValidationChunk* chunk = static_cast<ValidationChunk*> (obj);
+	chunk->parser->validateChunk(*chunk);
+	return 0;
+}
+
+/*
+ * Worker for validateXMLParallel. Only reads the source, so any number
+ * can run at once. Stops at the first mismatch that can be decided
+ * within the slice, which is the same one validateXML would report.
+ */
+void XMLParser::validateChunk(ValidationChunk& chunk)
+{
+	const char* base = sourceData + chunk.start;
+	size_t length = chunk.end - chunk.start;
+	std::vector<uint32_t> marks;
+	if (length <= XMLScanner::MAX_LENGTH)
 	{
-		errorMessage = tagStack.top() + " lacks closing tag.";
+		XMLScanner::findMarkup(base, length, marks);
 	}
-	for (unsigned int emptyStack = 0; emptyStack < tagStack.size(); emptyStack++)
+	size_t boundary = 0;
+	XMLSpan currentTag;
+	while ((!chunk.error) && (nextTagIn(base, length, marks, boundary, currentTag)))
 	{
-		tagStack.pop();
+		if (isDeclaration(currentTag) || isSelfClosing(currentTag))
+		{
+			continue;
+		}
+		XMLSpan name = elementName(currentTag);
+		if (!isClosing(currentTag))
+		{
+			chunk.opens.push_back(name);
+		}
+		else if (chunk.opens.empty())
+		{
+			// belongs to a tag opened in an earlier slice
+			chunk.closes.push_back(currentTag);
+		}
+		else if (name == chunk.opens.back())
+		{
+			chunk.opens.pop_back();
+		}
+		else
+		{
+			chunk.errorMessage = "Expected closing tag for <" + chunk.opens.back().str() + ">, but found "
+					+ currentTag.str() + ".";
+			chunk.error = true;
+		}
 	}
-	return false; // almost okay, stack not empty though so a closing tag missing?
 }
 
 void XMLParser::hierarchyToTerminal()
+{
+	XMLOutputSink sink(STDOUT_FILENO);
+	writeHierarchy(sink, HIERARCHY_TEXT);
+}
+
+/*
+ * Writes the tag tree to 'sink'. HIERARCHY_TEXT is the indented dump
+ * shown by hierarchyToTerminal; HIERARCHY_JSON writes one object per tag,
+ * {"depth":n,"offset":n,"tag":"..."}, and any error as {"error":"..."}.
+ */
+void XMLParser::writeHierarchy(XMLOutputSink& sink, HierarchyFormat format)
 {
 	int level = 0;
 	bool error = false;
-	if (xmlContents.length() == 0)
+	if (sourceLength == 0)
 	{
 		return;
 	}
-	std::stack<std::string> tagStack;
-	unsigned int cursorLocA = 0;
-	unsigned int cursorLocB = 0;
-	std::string currentTag = "";
-	do
+	std::stack<unsigned int> tagStack; // symbols of the open tags
+	size_t boundary = 0;
+	XMLSpan currentTag;
+	std::string errorMessage;
+	while ((!error) && (nextTag(boundary, currentTag)))
 	{
-		try
+		// First, carry on if tag is DTD or self closing
+		if (isDeclaration(currentTag) || isSelfClosing(currentTag))
 		{
-			cursorLocA = xmlContents.find("<", cursorLocB, 1);
-			cursorLocB = xmlContents.find(">", cursorLocA, 1);
-			if (cursorLocB == std::string::npos)
-			{
-				// end of file.
-				break;
-			}
-			currentTag = xmlContents.substr(cursorLocA, (cursorLocB - cursorLocA) + 1);
-			// First, carry on if tag is DTD or self closing
-			if ((currentTag.substr(0, 2) == "<?") || (currentTag.substr(currentTag.length() - 2, 2) == "/>"))
-			{
-				outputNode(currentTag, level);
-				continue;
-			}
-			if ((currentTag.substr(0, 1) == "<") && (currentTag.substr(0, 2) != "</"))
-			{
-				// open tag found
-				tagStack.push(currentTag);
-				outputNode(currentTag, level);
-				level++;
-			}
-			if (currentTag.substr(0, 2) == "</")
-			{
-				// closing tag found
-				if (currentTag.substr(2, currentTag.length() - 2) == tagStack.top().substr(1,
-						tagStack.top().length() - 1))
-				{
-					// okay, they match. Pop off opening tag
-					tagStack.pop();
-					level--;
-					outputNode(currentTag, level);
-				}
-				else
-				{
-					printf("Expected closing tag for %s, but found %s.", &tagStack.top()[0], &currentTag[0]);
-					error = true;
-				}
-			}
+			outputNode(sink, format, currentTag, level);
+			continue;
+		}
+		unsigned int symbol = internName(elementName(currentTag));
+		if (!isClosing(currentTag))
+		{
+			// open tag found
+			tagStack.push(symbol);
+			outputNode(sink, format, currentTag, level);
+			level++;
 		}
-		catch (std::exception exc)
+		else if (tagStack.empty())
 		{
-			printf("An unknown error occurred.");
+			errorMessage = "Found " + currentTag.str() + " with no open tag.";
+			error = true;
+		}
+		else if (symbol == tagStack.top())
+		{
+			// okay, they match. Pop off opening tag
+			tagStack.pop();
+			level--;
+			outputNode(sink, format, currentTag, level);
+		}
+		else
+		{
+			errorMessage = "Expected closing tag for <" + symbolNames[tagStack.top()].str() + ">, but found "
+					+ currentTag.str() + ".";
 			error = true;
 		}
 	}
-	while (!error);
-	if (!error) // check no existing errors....
+	if ((!error) && (!tagStack.empty())) // check no existing errors....
 	{
-		printf("%s lacks closing tag.", &tagStack.top()[0]);
+		errorMessage = "<" + symbolNames[tagStack.top()].str() + "> lacks closing tag.";
 	}
-	for (unsigned int emptyStack = 0; emptyStack < tagStack.size(); emptyStack++)
+	if (errorMessage.length() != 0)
 	{
-		tagStack.pop();
+		if (format == HIERARCHY_JSON)
+		{
+			sink.append("{\"error\":");
+			sink.appendJSONString(errorMessage);
+			sink.append("}\n");
+		}
+		else
+		{
+			sink.append(errorMessage);
+		}
 	}
 	return; // almost okay, stack not empty though so a closing tag missing?
 }
 
-void XMLParser::outputNode(std::string nodeName, int hierLevel)
+/*
+ * Steps to the next "<...>" in the source using the delimiter list from
+ * XMLScanner, which is built on first use. 'boundary' is the position in
+ * that list to resume from and should start at 0.
+ */
+bool XMLParser::nextTag(size_t& boundary, XMLSpan& tag)
 {
-	for (int indent = 0; indent < 4 * hierLevel; indent++)
+	if (!markupScanned)
 	{
-		printf(" ");
+		if (sourceLength <= XMLScanner::MAX_LENGTH)
+		{
+			XMLScanner::findMarkup(sourceData, sourceLength, markupIndex);
+		}
+		markupScanned = true;
+	}
+	return nextTagIn(sourceData, sourceLength, markupIndex, boundary, tag);
+}
+
+/*
+ * As nextTag, over any buffer 'base' whose delimiters are listed in 'marks'.
+ * A buffer too long for XMLScanner to index is searched with memchr
+ * instead, 'boundary' then being the byte offset to resume from.
+ */
+bool XMLParser::nextTagIn(const char* base, size_t length, const std::vector<uint32_t>& marks, size_t& boundary,
+		XMLSpan& tag)
+{
+	if (length > XMLScanner::MAX_LENGTH)
+	{
+		const char* open = (const char*) memchr(base + boundary, '<', length - boundary);
+		const char* close = (open == NULL) ? NULL : (const char*) memchr(open, '>', base + length - open);
+		if (close == NULL)
+		{
+			boundary = length;
+			return false;
+		}
+		boundary = close + 1 - base;
+		tag = XMLSpan(open, close - open + 1);
+		return true;
+	}
+	while ((boundary < marks.size()) && (base[marks[boundary]] != '<'))
+	{
+		boundary++;
+	}
+	size_t open = boundary;
+	while ((boundary < marks.size()) && (base[marks[boundary]] != '>'))
+	{
+		boundary++;
+	}
+	if (boundary >= marks.size())
+	{
+		// end of file.
+		return false;
+	}
+	tag = XMLSpan(base + marks[open], marks[boundary] - marks[open] + 1);
+	return true;
+}
+
+/*
+ * "<?...?>" processing instructions, and "<!...>" comments and DOCTYPEs:
+ * markup that neither opens nor closes an element.
+ */
+bool XMLParser::isDeclaration(const XMLSpan& tag)
+{
+	return (tag.length >= 2) && ((tag.data[1] == '?') || (tag.data[1] == '!'));
+}
+
+bool XMLParser::isSelfClosing(const XMLSpan& tag)
+{
+	return (tag.length >= 2) && (tag.data[tag.length - 2] == '/');
+}
+
+bool XMLParser::isClosing(const XMLSpan& tag)
+{
+	return (tag.length >= 2) && (tag.data[1] == '/');
+}
+
+void XMLParser::outputNode(XMLOutputSink& sink, HierarchyFormat format, XMLSpan nodeName, int hierLevel)
+{
+	if (format == HIERARCHY_JSON)
+	{
+		sink.append("{\"depth\":");
+		sink.appendNumber(hierLevel);
+		sink.append(",\"offset\":");
+		sink.appendNumber(nodeName.data - sourceData);
+		sink.append(",\"tag\":");
+		sink.appendJSONString(nodeName);
+		sink.append("}\n");
+		return;
 	}
-	printf("%s", &nodeName[0]);
-	printf("\n");
+	sink.appendIndent(4 * hierLevel);
+	sink.append(nodeName);
+	sink.append("\n");
 }
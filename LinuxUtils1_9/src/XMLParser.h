@@ -2,21 +2,82 @@
 #define XMLPARSER_H_
 
 #include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "XMLSpan.h"
+
+class XMLQuery;
+class XMLOutputSink;
 
 class XMLParser
 {
 	public:
+		enum HierarchyFormat
+		{
+			HIERARCHY_TEXT, HIERARCHY_JSON
+		};
 		XMLParser();
 		virtual ~XMLParser();
-		bool setSource(std::string xmlText);
+		bool setSource(const std::string& xmlText);
+		bool setSource(const char* xmlText, size_t length);
 		bool setSource(std::ifstream* xmlFile);
-		std::string getTagValue(std::string xmlTag, unsigned int nth = 1);
-		int getTagCount(std::string xmlTag);
+		bool setSourceFile(const std::string& path);
+		std::string getTagValue(XMLSpan xmlTag, unsigned int nth = 1);
+		XMLSpan getTagSpan(XMLSpan xmlTag, unsigned int nth = 1);
+		int getTagCount(XMLSpan xmlTag);
+		size_t runQueries(std::vector<XMLQuery*>& queries);
 		bool validateXML(std::string& errorMessage);
+		bool validateXMLParallel(std::string& errorMessage, unsigned int workerCount = 0);
 		void hierarchyToTerminal();
+		void writeHierarchy(XMLOutputSink& sink, HierarchyFormat format = HIERARCHY_TEXT);
 	private :
-		std::string xmlContents;
-		void outputNode(std::string nodeName, int hierLevel);
+		/*
+		 * One entry per plain opening tag ("<name>") in the source,
+		 * holding offsets of the tag name and of the text that follows it.
+		 * Sorted by name, then by position, so all occurrences of a tag
+		 * sit together in document order.
+		 */
+		struct TagEntry
+		{
+				size_t nameStart;
+				size_t nameLength;
+				size_t valueStart;
+				size_t valueEnd;
+		};
+		struct TagOrder;
+		struct QueryElement;
+		struct QuerySibling;
+		struct ValidationChunk;
+		std::string xmlContents; // owned copy, if the source was not borrowed
+		const char* sourceData;
+		size_t sourceLength;
+		void* mappedData; // set when the source is a mapped file
+		size_t mappedLength;
+		std::vector<TagEntry> tagIndex;
+		std::vector<uint32_t> markupIndex; // offsets of every '<' and '>', unless sourceLength is over XMLScanner::MAX_LENGTH
+		bool markupScanned;
+		static const unsigned int NO_SYMBOL = (unsigned int) -1;
+		std::vector<XMLSpan> symbolNames; // tag names interned for this document
+		std::vector<unsigned int> symbolSlots; // hash table of indexes into symbolNames
+		void buildIndex();
+		void releaseMapping();
+		bool findTag(XMLSpan xmlTag, size_t& first, size_t& count);
+		bool nextTag(size_t& boundary, XMLSpan& tag);
+		bool nextTagIn(const char* base, size_t length, const std::vector<uint32_t>& marks, size_t& boundary,
+				XMLSpan& tag);
+		static void* start_validation(void* obj);
+		void validateChunk(ValidationChunk& chunk);
+		bool isDeclaration(const XMLSpan& tag);
+		bool isSelfClosing(const XMLSpan& tag);
+		bool isClosing(const XMLSpan& tag);
+		XMLSpan elementName(const XMLSpan& tag);
+		unsigned int internName(XMLSpan name);
+		size_t hashName(XMLSpan name);
+		void outputNode(XMLOutputSink& sink, HierarchyFormat format, XMLSpan nodeName, int hierLevel);
+		// not copyable: mappedData is unmapped by its owner and sourceData may point into xmlContents
+		XMLParser(const XMLParser&);
+		XMLParser& operator=(const XMLParser&);
 };
 
 #endif /* XMLPARSER_H_ */
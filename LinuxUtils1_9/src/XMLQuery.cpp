@@ -0,0 +1,98 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "XMLQuery.h"
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+XMLQuery::XMLQuery(const std::string& path)
+{
+	valid = true;
+	size_t stepStart = 0;
+	while (valid && (stepStart <= path.length()))
+	{
+		size_t stepEnd = path.find('/', stepStart);
+		if (stepEnd == std::string::npos)
+		{
+			stepEnd = path.length();
+		}
+		std::string text = path.substr(stepStart, stepEnd - stepStart);
+		Step step;
+		step.position = 0;
+		size_t bracket = text.find('[');
+		if (bracket != std::string::npos)
+		{
+			std::string selector = text.substr(bracket + 1);
+			if ((selector.length() < 2) || (selector[selector.length() - 1] != ']'))
+			{
+				valid = false;
+			}
+			else if (selector != "*]")
+			{
+				char* end;
+				long position = strtol(selector.c_str(), &end, 10);
+				if ((position < 1) || (*end != ']'))
+				{
+					valid = false;
+				}
+				step.position = (unsigned int) position;
+			}
+			text = text.substr(0, bracket);
+		}
+		if (text.length() == 0)
+		{
+			valid = false;
+		}
+		step.name = text;
+		steps.push_back(step);
+		stepStart = stepEnd + 1;
+	}
+}
+
+XMLQuery::~XMLQuery()
+{
+}
+
+/*
+ * False if the path could not be compiled. An invalid query never matches.
+ */
+bool XMLQuery::isValid()
+{
+	return valid;
+}
+
+size_t XMLQuery::getMatchCount()
+{
+	return matches.size();
+}
+
+/*
+ * Text following the 'nth' matching tag (counting from 1), as a span into
+ * the parser's source. Empty if there is no such match.
+ */
+XMLSpan XMLQuery::getMatch(size_t nth)
+{
+	if ((nth == 0) || (nth > matches.size()))
+	{
+		return XMLSpan();
+	}
+	return matches[nth - 1];
+}
+
+std::string XMLQuery::getMatchValue(size_t nth)
+{
+	return getMatch(nth).str();
+}
@@ -0,0 +1,37 @@
+#ifndef XMLQUERY_H_
+#define XMLQUERY_H_
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "XMLSpan.h"
+
+/*
+ * A path such as "rss/channel/item[*]/title", compiled once and then
+ * evaluated by XMLParser::runQueries. Each step names an element below
+ * the previous one, starting from the document root. A step may add
+ * "[n]" to select only the nth element of that name under its parent
+ * (counting from 1); "[*]", or no brackets, selects all of them.
+ */
+class XMLQuery
+{
+	public:
+		XMLQuery(const std::string& path);
+		virtual ~XMLQuery();
+		bool isValid();
+		size_t getMatchCount();
+		XMLSpan getMatch(size_t nth);
+		std::string getMatchValue(size_t nth);
+	private:
+		friend class XMLParser;
+		struct Step
+		{
+				std::string name;
+				unsigned int position; // 0 for any
+		};
+		std::vector<Step> steps;
+		bool valid;
+		std::vector<XMLSpan> matches; // text of each match, in document order
+};
+
+#endif /* XMLQUERY_H_ */
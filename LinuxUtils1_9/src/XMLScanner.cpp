@@ -0,0 +1,94 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "XMLScanner.h"
+#include "ScannerSupport.h"
+#include <vector>
+
+/*
+ * Appends the offset of every '<' and '>' in 'data' to 'boundaries',
+ * in ascending order. 'length' must be at most MAX_LENGTH.
+ */
+void XMLScanner::findMarkup(const char* data, size_t length, std::vector<uint32_t>& boundaries)
+{
+	size_t pos = 0;
+	if (cpuHasAVX2())
+	{
+		pos = findMarkupAVX2(data, pos, length, boundaries);
+	}
+	pos = findMarkupSSE2(data, pos, length, boundaries);
+	findMarkupScalar(data, pos, length, boundaries);
+}
+
+size_t XMLScanner::findMarkupScalar(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries)
+{
+	for (size_t pos = from; pos < length; pos++)
+	{
+		if ((data[pos] == '<') || (data[pos] == '>'))
+		{
+			boundaries.push_back((uint32_t) pos);
+		}
+	}
+	return length;
+}
+
+#ifdef SCANNER_X86
+
+/*
+ * Both vector loops stop short of the last partial block and return
+ * where they got to, leaving the tail to the next narrower loop.
+ */
+size_t XMLScanner::findMarkupSSE2(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries)
+{
+	const __m128i open = _mm_set1_epi8('<');
+	const __m128i close = _mm_set1_epi8('>');
+	size_t pos = from;
+	for (; pos + 16 <= length; pos += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*) (data + pos));
+		__m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, open), _mm_cmpeq_epi8(block, close));
+		pushMask((unsigned int) _mm_movemask_epi8(hits), pos, boundaries);
+	}
+	return pos;
+}
+
+__attribute__((target("avx2")))
+size_t XMLScanner::findMarkupAVX2(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries)
+{
+	const __m256i open = _mm256_set1_epi8('<');
+	const __m256i close = _mm256_set1_epi8('>');
+	size_t pos = from;
+	for (; pos + 32 <= length; pos += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*) (data + pos));
+		__m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, open), _mm256_cmpeq_epi8(block, close));
+		pushMask((unsigned int) _mm256_movemask_epi8(hits), pos, boundaries);
+	}
+	return pos;
+}
+
+#else
+
+size_t XMLScanner::findMarkupSSE2(const char*, size_t from, size_t, std::vector<uint32_t>&)
+{
+	return from;
+}
+
+size_t XMLScanner::findMarkupAVX2(const char*, size_t from, size_t, std::vector<uint32_t>&)
+{
+	return from;
+}
+
+#endif
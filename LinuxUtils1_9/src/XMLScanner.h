@@ -0,0 +1,26 @@
+#ifndef XMLSCANNER_H_
+#define XMLSCANNER_H_
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Locates markup delimiters ('<' and '>') in a buffer in a single pass.
+ * Uses SSE2 on x86, or AVX2 when the CPU reports it at runtime, and a
+ * plain byte loop everywhere else. Offsets are 32 bits, half the size of
+ * size_t ones on 64-bit builds, so buffers longer than MAX_LENGTH cannot
+ * be indexed.
+ */
+class XMLScanner
+{
+	public:
+		static const size_t MAX_LENGTH = 0xFFFFFFFFu;
+		static void findMarkup(const char* data, size_t length, std::vector<uint32_t>& boundaries);
+	private:
+		static size_t findMarkupScalar(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries);
+		static size_t findMarkupSSE2(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries);
+		static size_t findMarkupAVX2(const char* data, size_t from, size_t length, std::vector<uint32_t>& boundaries);
+};
+
+#endif /* XMLSCANNER_H_ */
@@ -0,0 +1,109 @@
+#ifndef XMLSPAN_H_
+#define XMLSPAN_H_
+
+#include <string>
+#include <string.h>
+#include <stddef.h>
+
+/*
+ * Read-only view of a run of characters, normally pointing straight into
+ * an XMLParser source buffer. Nothing is copied, so a span is only valid
+ * for as long as the buffer it points into.
+ */
+struct XMLSpan
+{
+		const char* data;
+		size_t length;
+
+		static const size_t npos = (size_t) -1;
+
+		XMLSpan() :
+			data(""), length(0)
+		{
+		}
+		XMLSpan(const char* text, size_t textLength) :
+			data(text), length(textLength)
+		{
+		}
+		XMLSpan(const char* text) :
+			data(text), length(strlen(text))
+		{
+		}
+		XMLSpan(const std::string& text) :
+			data(text.data()), length(text.length())
+		{
+		}
+
+		bool empty() const
+		{
+			return length == 0;
+		}
+
+		std::string str() const
+		{
+			return std::string(data, length);
+		}
+
+		XMLSpan substr(size_t pos, size_t count = npos) const
+		{
+			if (pos > length)
+			{
+				pos = length;
+			}
+			if (count > length - pos)
+			{
+				count = length - pos;
+			}
+			return XMLSpan(data + pos, count);
+		}
+
+		bool operator==(const XMLSpan& other) const
+		{
+			return (length == other.length) && (memcmp(data, other.data, length) == 0);
+		}
+
+		bool operator!=(const XMLSpan& other) const
+		{
+			return !(*this == other);
+		}
+
+		// Position of the first occurrence of 'needle', or npos.
+		size_t find(const XMLSpan& needle) const
+		{
+			if (needle.length == 0)
+			{
+				return 0;
+			}
+			const char* cursor = data;
+			const char* last = data + length;
+			while ((size_t) (last - cursor) >= needle.length)
+			{
+				cursor = (const char*) memchr(cursor, needle.data[0], (last - cursor) - needle.length + 1);
+				if (cursor == NULL)
+				{
+					return npos;
+				}
+				if (memcmp(cursor, needle.data, needle.length) == 0)
+				{
+					return cursor - data;
+				}
+				cursor++;
+			}
+			return npos;
+		}
+
+		// Position of the first byte also found in 'charSet', or npos.
+		size_t findFirstOf(const XMLSpan& charSet) const
+		{
+			for (size_t pos = 0; pos < length; pos++)
+			{
+				if (memchr(charSet.data, data[pos], charSet.length) != NULL)
+				{
+					return pos;
+				}
+			}
+			return npos;
+		}
+};
+
+#endif /* XMLSPAN_H_ */
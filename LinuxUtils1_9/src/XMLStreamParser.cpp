@@ -0,0 +1,201 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "XMLStreamParser.h"
+#include <string>
+#include <vector>
+#include <string.h>
+
+XMLStreamParser::XMLStreamParser(XMLStreamListener* eventListener)
+{
+	listener = eventListener;
+	reset();
+}
+
+XMLStreamParser::~XMLStreamParser()
+{
+}
+
+/*
+ * Clears all state, ready for a new document.
+ */
+void XMLStreamParser::reset()
+{
+	partialTag.clear();
+	inTag = false;
+	tagDepth = 0;
+	errorText.clear();
+	error = false;
+}
+
+bool XMLStreamParser::feed(const std::string& chunk)
+{
+	return feed(chunk.data(), chunk.length());
+}
+
+/*
+ * Parses as much of 'chunk' as possible, emitting events as it goes.
+ * A tag cut off at the end of the chunk is held back until the next feed.
+ * Returns false once an error has been found; later input is ignored.
+ */
+bool XMLStreamParser::feed(const char* chunk, size_t length)
+{
+	size_t pos = 0;
+	size_t tagBegin = XMLSpan::npos; // start of the current tag, if it began in this chunk
+	while ((!error) && (pos < length))
+	{
+		if (inTag)
+		{
+			const char* tagEnd = (const char*) memchr(chunk + pos, '>', length - pos);
+			if (tagEnd == NULL)
+			{
+				if (tagBegin != XMLSpan::npos)
+				{
+					partialTag.assign(chunk + tagBegin, length - tagBegin);
+				}
+				else
+				{
+					partialTag.append(chunk + pos, length - pos);
+				}
+				break;
+			}
+			size_t end = (tagEnd - chunk) + 1;
+			if (tagBegin != XMLSpan::npos)
+			{
+				handleTag(XMLSpan(chunk + tagBegin, end - tagBegin));
+			}
+			else
+			{
+				partialTag.append(chunk + pos, end - pos);
+				handleTag(XMLSpan(partialTag));
+				partialTag.clear();
+			}
+			inTag = false;
+			tagBegin = XMLSpan::npos;
+			pos = end;
+		}
+		else
+		{
+			const char* tagStart = (const char*) memchr(chunk + pos, '<', length - pos);
+			size_t end = (tagStart != NULL) ? (size_t) (tagStart - chunk) : length;
+			if ((end > pos) && (listener != NULL))
+			{
+				listener->text(XMLSpan(chunk + pos, end - pos));
+			}
+			if (tagStart == NULL)
+			{
+				break;
+			}
+			inTag = true;
+			tagBegin = end;
+			pos = end + 1;
+			if (pos == length)
+			{
+				// the '<' is the last byte, so carry it over to the next chunk
+				partialTag = "<";
+			}
+		}
+	}
+	return !error;
+}
+
+/*
+ * Call once the input has ended. Returns true if the document was well
+ * formed, otherwise fills in 'errorMessage'.
+ */
+bool XMLStreamParser::finish(std::string& errorMessage)
+{
+	if ((!error) && (inTag))
+	{
+		errorText = "Unterminated tag " + partialTag + ".";
+		error = true;
+	}
+	if ((!error) && (tagDepth != 0))
+	{
+		errorText = "<" + tagStack[tagDepth - 1] + "> lacks closing tag.";
+		error = true;
+	}
+	errorMessage = errorText;
+	return !error;
+}
+
+/*
+ * The name of 'tag' starting at 'offset', up to whitespace, '/' or '>'.
+ */
+XMLSpan XMLStreamParser::tagName(XMLSpan tag, size_t offset)
+{
+	size_t end = offset;
+	while ((end < tag.length) && (strchr(" \t\r\n/>", tag.data[end]) == NULL))
+	{
+		end++;
+	}
+	return tag.substr(offset, end - offset);
+}
+
+/*
+ * 'tag' is a complete "<...>", delimiters included.
+ */
+void XMLStreamParser::handleTag(XMLSpan tag)
+{
+	// First, carry on if tag is DTD or a comment
+	if ((tag.length >= 2) && ((tag.data[1] == '?') || (tag.data[1] == '!')))
+	{
+		return;
+	}
+	if ((tag.length >= 2) && (tag.data[1] == '/'))
+	{
+		// closing tag found
+		XMLSpan name = tagName(tag, 2);
+		if (tagDepth == 0)
+		{
+			errorText = "Found " + tag.str() + " with no open tag.";
+			error = true;
+		}
+		else if (name != XMLSpan(tagStack[tagDepth - 1]))
+		{
+			errorText = "Expected closing tag for <" + tagStack[tagDepth - 1] + ">, but found " + tag.str() + ".";
+			error = true;
+		}
+		else
+		{
+			tagDepth--;
+			if (listener != NULL)
+			{
+				listener->closeTag(name);
+			}
+		}
+		return;
+	}
+	XMLSpan name = tagName(tag, 1);
+	if (listener != NULL)
+	{
+		listener->openTag(name);
+	}
+	if (tag.data[tag.length - 2] == '/')
+	{
+		// self closing
+		if (listener != NULL)
+		{
+			listener->closeTag(name);
+		}
+		return;
+	}
+	if (tagDepth == tagStack.size())
+	{
+		tagStack.push_back(std::string());
+	}
+	tagStack[tagDepth].assign(name.data, name.length);
+	tagDepth++;
+}
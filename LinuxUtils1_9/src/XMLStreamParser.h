@@ -0,0 +1,53 @@
+#ifndef XMLSTREAMPARSER_H_
+#define XMLSTREAMPARSER_H_
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "XMLSpan.h"
+
+/*
+ * Receives events from an XMLStreamParser. Spans are only valid for the
+ * duration of the call. Text between two tags may arrive in several
+ * pieces if it straddles a chunk boundary.
+ */
+class XMLStreamListener
+{
+	public:
+		virtual ~XMLStreamListener()
+		{
+		}
+		virtual void openTag(XMLSpan name) = 0;
+		virtual void closeTag(XMLSpan name) = 0;
+		virtual void text(XMLSpan content) = 0;
+};
+
+/*
+ * Push parser for XML that arrives in pieces. Call feed() with each chunk
+ * as it is received and finish() once the input ends. Only the tag stack
+ * and any tag cut off at the end of a chunk are kept between calls, so
+ * memory use does not grow with the document. finish() reports the same
+ * errors as XMLParser::validateXML; both skip "<?...?>" and "<!...>".
+ */
+class XMLStreamParser
+{
+	public:
+		XMLStreamParser(XMLStreamListener* eventListener);
+		virtual ~XMLStreamParser();
+		bool feed(const char* chunk, size_t length);
+		bool feed(const std::string& chunk);
+		bool finish(std::string& errorMessage);
+		void reset();
+	private:
+		XMLStreamListener* listener;
+		std::string partialTag; // tag cut off by the end of the last chunk
+		bool inTag;
+		std::vector<std::string> tagStack;
+		size_t tagDepth; // live entries in tagStack, which is kept for reuse
+		std::string errorText;
+		bool error;
+		void handleTag(XMLSpan tag);
+		XMLSpan tagName(XMLSpan tag, size_t offset);
+};
+
+#endif /* XMLSTREAMPARSER_H_ */
@@ -19,12 +19,19 @@
 #include "SDL_ttf.h"	// SDL TTF support
 #include <math.h>		// sqrt function
 #include <time.h>		// for polling weather data updating
+#include <unistd.h>		// sleep between weather retries
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 #include "SDL_SoundPlayer.h"
 #include "Slider.h"
 #include "WeatherData.h"
+#include "WeatherLocations.h"
+#include "GammaRamp.h"
+#include "GammaApplier.h"
+#include "GammaTransition.h"
 
 /*
  * Customise to suit your particular monitor.....
@@ -47,11 +54,19 @@ const int D55_R = 98; // in percent
 const int D55_G = 91; // in percent
 const int D55_B = 78; // in percent
 const int D55_A = 32; // in percent
+const unsigned int PRESET_DURATION = 400; // milliseconds to glide to a preset
+const unsigned int REFRESH_INTERVAL = 16; // milliseconds, ~60Hz: at most one gamma change per refresh
 /*
  * Customise for weather for your location
  * Note, expects 3 day forecast, so only amend 2654497 to the value of your location.
+ * The GUI cycles through the locations with a forecast; '-weather' reports them all.
  */
-std::string weatherXML = "http://open.live.bbc.co.uk/weather/feeds/en/2654497/3dayforecast.rss";
+const char* weatherSites[][2] =
+{
+	{ "Home", "http://open.live.bbc.co.uk/weather/feeds/en/2654497/3dayforecast.rss" },
+	// { "Name", "http://open.live.bbc.co.uk/weather/feeds/en/<location>/3dayforecast.rss" },
+};
+const Uint32 WEATHER_CYCLE = 5000; // milliseconds each location is shown in the GUI
 //
 const int VERSION_MAJOR = 1;
 const int VERSION_MINOR = 9;
@@ -86,12 +101,16 @@ const std::string REV_DATE = "11/04/2012";
  *							as well as local cache and thumbnail files.
  *						-gamma
  *							Applies last gamma values without invoking GUI.
+ *						-benchmark
+ *							Times in-process gamma changes against xgamma.
  *						-help
  * 							Displays assistance information.
  * 						-silent
  * 							Suppresses output of messages to terminal.
  * 						-weather
  * 							Provides a 3-day weather forecast to terminal window.
+ * 						-weather --format=json|csv|tsv
+ * 							The same forecast for every location, for scripts.
  * 						no switch
  * 							Launches GUI.
  * ----------------------------------------------------------------------------------------------
@@ -109,6 +128,8 @@ void menu1saveRGBsettings();
 void menu2shredItems();
 void menu1applyRGB();
 void menu1applyPreset(int colourTemp);
+void menu1advancePreset();
+void benchmarkGamma();
 int initGFX();
 int initFont();
 void keyProcess(SDL_keysym*, bool);
@@ -119,6 +140,7 @@ void drawMenuHL();
 void drawMenu1Page();
 void drawMenu2Page();
 void drawMenu3Page();
+void drawForecastTrend(ForecastHistory* history, int left, int top, int width, int height);
 void updateGFX();
 SDL_Surface* initDisplay();
 bool outputText(int x, int y, std::string text, unsigned int r, unsigned int g, unsigned int b, bool large);
@@ -133,6 +155,7 @@ TTF_Font* fontFaceLarge; // pointer to font struct
 TTF_Font* fontFaceSmall; // pointer to font struct
 FILE *program; // text file holding settings
 bool globalSilence;
+bool globalVerbose; // report statistics on exit
 SDL_Surface *screen; // 2D drawing plane
 SDL_Surface *background; // 2D drawing plane
 SDL_Surface *menu; // 2D drawing plane
@@ -148,13 +171,16 @@ Uint32 BLUE = 0x0000FF00;
 Uint32 WHITE = 0xFFFFFF00;
 Uint32 YELLOW = 0xFFFF0000;
 Slider* menu1sliders[4] = { NULL, NULL, NULL, NULL };
-WeatherData* weatherDataGrabber;
+WeatherLocations* weatherLocations; // every entry of weatherSites, for the GUI
+GammaApplier* gammaApplier = NULL; // started by the first gamma change
+GammaTransition* menu1transition = NULL; // glide to the preset last clicked
 int menu1sliderLength = 180;
 bool menu2Cleaned;
 bool weatherDataValid; // true if weather data successfully updated
 
 int main(int argc, char* argv[])
 {
+	GammaRamp::initThreads();
 	if (initGFX())
 	{
 		quitApp = true;
@@ -180,6 +206,7 @@ int main(int argc, char* argv[])
 	while (!quitApp)
 	{
 		processEvents();
+		menu1advancePreset();
 		updateGFX();
 	}
 	cleanup();
@@ -191,6 +218,7 @@ int parseArgs(int argc, char* argv[])
 	std::string argFull = "";
 	int result = 0;
 	globalSilence = false;
+	globalVerbose = false;
 	if (argc < 2)
 	{
 		return result;
@@ -211,6 +239,10 @@ int parseArgs(int argc, char* argv[])
 		globalSilence = true;
 		result = 1;
 	}
+	if ((argFull.find("-verbose") != std::string::npos) && !globalSilence)
+	{
+		globalVerbose = true;
+	}
 	if (argFull.find("-help") != std::string::npos)
 	{
 		showHelp();
@@ -226,38 +258,127 @@ int parseArgs(int argc, char* argv[])
 		menu1loadRGBdefaults();
 		result = 1;
 	}
+	if (argFull.find("-benchmark") != std::string::npos)
+	{
+		benchmarkGamma();
+		result = 1;
+	}
 	if (argFull.find("-weather") != std::string::npos)
 	{
-		weatherDataGrabber = new WeatherData();
-		weatherDataGrabber->updateWeatherData(weatherXML);
+		WeatherLocations::ForecastFormat format = WeatherLocations::FORECAST_TEXT;
+		size_t formatArg = argFull.find("-format=");
+		if (formatArg != std::string::npos)
+		{
+			std::string formatName = argFull.substr(formatArg + 8, argFull.find(' ', formatArg) - formatArg - 8);
+			if (formatName == "json")
+			{
+				format = WeatherLocations::FORECAST_JSON;
+			}
+			else if (formatName == "csv")
+			{
+				format = WeatherLocations::FORECAST_CSV;
+			}
+			else if (formatName == "tsv")
+			{
+				format = WeatherLocations::FORECAST_TSV;
+			}
+			else if (formatName != "text")
+			{
+				fprintf(stderr, "Unknown weather format '%s': use text, json, csv or tsv.\n", formatName.c_str());
+				return 1;
+			}
+		}
+		// progress and timings would get in the way of a machine readable format
+		bool chatty = (format == WeatherLocations::FORECAST_TEXT);
+		WeatherLocations locations;
+		size_t siteCount = sizeof(weatherSites) / sizeof(weatherSites[0]);
+		for (size_t site = 0; site < siteCount; site++)
+		{
+			locations.addLocation(weatherSites[site][0], weatherSites[site][1]);
+		}
 		int tries = 3;
-		printf("Trying to connect to weather feed...\n\n");
-		time_t timeLast, timeCurrent;
-		timeLast = timeCurrent = time(NULL);
+		const long long attemptTimeout = 15000; // milliseconds
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		// milliseconds, across all tries; each fetch is cut off when it runs out
+		const long long deadline = (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000 + 40000;
+		long long remaining = 40000;
+		size_t upToDate = 0;
+		if (chatty)
+		{
+			printf("Trying to connect to weather feed...\n\n");
+		}
 		do
 		{
-			weatherDataValid = weatherDataGrabber->isDataValid();
-			if (!weatherDataValid)
+			// fetches the locations still missing together, and blocks until they finish
+			upToDate = locations.fetchAll((int) std::min(attemptTimeout, remaining));
+			tries--;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			remaining = deadline - ((long long) now.tv_sec * 1000 + now.tv_nsec / 1000000);
+			if ((upToDate < siteCount) && (tries > 0) && (remaining > 2000))
 			{
-				timeCurrent = time(NULL);
-				if (timeCurrent - timeLast > 2)	// only polls every 2 seconds
+				sleep(2); // give the network a moment before trying again
+				remaining -= 2000;
+				if (chatty)
 				{
 					printf("Trying to connect to weather feed...\n\n");
-					weatherDataGrabber->updateWeatherData(weatherXML);
-					tries--;
-					timeLast = time(NULL);
 				}
 			}
-			else
+		}
+		while ((tries > 0) && (upToDate < siteCount) && (remaining > 0));
+		// a stale cached forecast is still worth showing if the network let us down
+		weatherDataValid = false;
+		for (size_t site = 0; site < siteCount; site++)
+		{
+			weatherDataValid = weatherDataValid || locations.getLocation(site)->isDataValid();
+		}
+		if (!chatty)
+		{
+			// written even if nothing was fetched, so a script always gets a well formed document
+			locations.writeForecast(STDOUT_FILENO, format);
+			if (!weatherDataValid)
+			{
+				fprintf(stderr, "Failed to connect to weather feed...\n");
+			}
+		}
+		else if (weatherDataValid)
+		{
+			locations.forecastToTerminal();
+			for (size_t site = 0; site < siteCount; site++)
+			{
+				if (locations.wasFetched(site) && locations.getLocation(site)->isDataValid())
+				{
+					WeatherData::FETCH_TIMING timing = locations.getLocation(site)->getLastFetchTiming();
+					printf("%s fetched in %.0f ms (DNS %.0f ms, connect %.0f ms, transfer %.0f ms, parse %.1f ms)\n",
+							weatherSites[site][0], timing.resolve + timing.connect + timing.transfer
+									+ timing.parse, timing.resolve, timing.connect, timing.transfer, timing.parse);
+				}
+			}
+			printf("\n");
+			for (size_t site = 0; site < siteCount; site++)
 			{
-				weatherDataGrabber->forecastToTerminal();
+				if (locations.getLocation(site)->getHistory()->getCount() != 0)
+				{
+					printf("%s: ", weatherSites[site][0]);
+					locations.getLocation(site)->historyToTerminal();
+				}
 			}
+			printf("\n");
 		}
-		while ((tries > 0) && (!weatherDataValid));
-		if (!weatherDataValid)
+		else
 		{
 			printf("Failed to connect to weather feed...\n\n");
 		}
+		if (chatty)
+		{
+			for (size_t site = 0; site < siteCount; site++)
+			{
+				WeatherData::FETCH_STATS stats = locations.getLocation(site)->getFetchStats();
+				printf("%s: %lu fetches issued, %lu skipped, %lu failed\n", weatherSites[site][0], stats.issued,
+						stats.skipped, stats.failed);
+			}
+			printf("\n");
+		}
 		result = 1;
 	}
 	return result; // zero means proceed with GUI launch
@@ -284,13 +405,22 @@ void showHelp()
 	printf("          as well as local cache and thumbnail files.\n");
 	printf("     -gamma\n");
 	printf("          Applies last gamma values without invoking GUI.\n");
+	printf("     -benchmark\n");
+	printf("          Times gamma changes through the X server against running xgamma,\n");
+	printf("          checks the ramp generator against pow(), then restores the saved gamma.\n");
 	printf("     -help\n");
 	printf("          Displays these assistance notes.\n");
 	printf("     -silent\n");
 	printf("          Inhibits output to terminal window. Can be used in conjunction\n");
 	printf("          with other command switch options.\n");
+	printf("     -verbose\n");
+	printf("          Reports how many gamma changes were applied, coalesced or\n");
+	printf("          skipped when the GUI closes.\n");
 	printf("     -weather\n");
 	printf("          Provides a 3-day weather forecast.\n");
+	printf("     -weather --format=json|csv|tsv\n");
+	printf("          Writes the forecast for every location in a form for scripts.\n");
+	printf("          Uses the cached forecast while it is still fresh.\n");
 	printf("------------------------------------------------------------------------\n");
 	printf("Author  : Christopher Walker\n");
 	printf("Version : %d.%d\n", VERSION_MAJOR, VERSION_MINOR);
@@ -334,7 +464,15 @@ void cleanup()
 	try
 	{
 		delete wavPlayer;
-		delete weatherDataGrabber;
+		delete weatherLocations;
+		delete menu1transition;
+		if ((gammaApplier != NULL) && globalVerbose)
+		{
+			GammaApplier::APPLY_STATS stats = gammaApplier->getStats();
+			printf("Gamma changes: %lu applied, %lu coalesced, %lu skipped\n", stats.applied, stats.coalesced,
+					stats.skipped);
+		}
+		delete gammaApplier;
 	}
 	catch (std::exception exc)
 	{
@@ -352,10 +490,15 @@ void cleanup()
 
 bool initDefaults()
 {
-	weatherDataGrabber = new WeatherData();
+	weatherLocations = new WeatherLocations();
+	for (size_t site = 0; site < sizeof(weatherSites) / sizeof(weatherSites[0]); site++)
+	{
+		weatherLocations->addLocation(weatherSites[site][0], weatherSites[site][1]);
+	}
 	activeMenuSelection = 1;
 	lastActiveMenuSelection = 1;
 	mouseButtonDown = false;
+	menu1transition = new GammaTransition(XGAMMA_MAX_VALUE, REFRESH_INTERVAL);
 	menu1loadRGBdefaults();
 	// if we are not instantiating GUI, quit now by signalling
 	if (globalSilence)
@@ -524,22 +667,13 @@ void menu2shredItems()
 
 void menu1applyRGB()
 {
-	// Use values in menu1sliders to calculate RGB using A as multiplier
-	std::string com;
-	float rVal, gVal, bVal, aVal;
-	aVal = menu1sliders[3]->GetSliderValue();
-	rVal = menu1sliders[0]->GetSliderValue() * (aVal / 100);
-	gVal = menu1sliders[1]->GetSliderValue() * (aVal / 100);
-	bVal = menu1sliders[2]->GetSliderValue() * (aVal / 100);
-	// rVal et al now value between 0 > 100%. Map to 0.1 > XGAMMA_MAX_VALUE
-	double scaleFactor = ((XGAMMA_MAX_VALUE - 0.1) / 100);
-	rVal = 0.1 + (rVal * scaleFactor);
-	gVal = 0.1 + (gVal * scaleFactor);
-	bVal = 0.1 + (bVal * scaleFactor);
-	com = "xgamma -rgamma " + to_string(rVal) + " -ggamma " + to_string(gVal) + " -bgamma " + to_string(bVal)
-			+ " -quiet";
-	const char* comm = &com[0];
-	system(comm);
+	// Hand the slider values to the applier thread, which maps RGB using A as multiplier
+	if (gammaApplier == NULL)
+	{
+		gammaApplier = new GammaApplier(XGAMMA_MAX_VALUE);
+	}
+	gammaApplier->post(menu1sliders[0]->GetSliderValue(), menu1sliders[1]->GetSliderValue(),
+			menu1sliders[2]->GetSliderValue(), menu1sliders[3]->GetSliderValue());
 }
 
 void menu1applyPreset(int colourTemp)
@@ -571,60 +705,114 @@ void menu1applyPreset(int colourTemp)
 			bTarget = RGB_DEFAULT;
 			aTarget = GAMMA_DEFAULT;
 	}
+	// Glide there from the main loop, so events keep being handled meanwhile
+	float current[4], target[4] = { (float) rTarget, (float) gTarget, (float) bTarget, (float) aTarget };
+	for (int loop = 0; loop < 4; loop++)
+	{
+		current[loop] = menu1sliders[loop]->GetSliderValue();
+	}
 	wavPlayer->playWav(2);
-	bool gammaReset = false;
-	while (!gammaReset)
+	menu1transition->start(current, target, SDL_GetTicks(), PRESET_DURATION);
+}
+
+/*
+ * Called once per frame: moves the sliders along any preset glide and
+ * applies the new values, at most once per REFRESH_INTERVAL.
+ */
+void menu1advancePreset()
+{
+	float values[4];
+	if (!menu1transition->advance(SDL_GetTicks(), values))
 	{
-		if (menu1sliders[0]->GetSliderValue() > rTarget)
-		{
-			menu1sliders[0]->SetSliderValue(menu1sliders[0]->GetSliderValue() - 1);
-		}
-		if (menu1sliders[0]->GetSliderValue() < rTarget)
-		{
-			menu1sliders[0]->SetSliderValue(menu1sliders[0]->GetSliderValue() + 1);
-		}
-		if (menu1sliders[1]->GetSliderValue() > gTarget)
-		{
-			menu1sliders[1]->SetSliderValue(menu1sliders[1]->GetSliderValue() - 1);
-		}
-		if (menu1sliders[1]->GetSliderValue() < gTarget)
-		{
-			menu1sliders[1]->SetSliderValue(menu1sliders[1]->GetSliderValue() + 1);
-		}
-		if (menu1sliders[2]->GetSliderValue() > bTarget)
-		{
-			menu1sliders[2]->SetSliderValue(menu1sliders[2]->GetSliderValue() - 1);
-		}
-		if (menu1sliders[2]->GetSliderValue() < bTarget)
-		{
-			menu1sliders[2]->SetSliderValue(menu1sliders[2]->GetSliderValue() + 1);
-		}
-		if (menu1sliders[3]->GetSliderValue() > aTarget)
+		return;
+	}
+	for (int loop = 0; loop < 4; loop++)
+	{
+		menu1sliders[loop]->SetSliderValue(values[loop]);
+	}
+	menu1applyRGB();
+	if (!menu1transition->isActive())
+	{
+		wavPlayer->playWav(2);
+	}
+}
+
+void benchmarkGamma()
+{
+	// Time the in-process backend against one xgamma process per change, alternating values so every apply is real work.
+	// The two gammas are close enough (under half a percent of full brightness apart) that the screen does not flicker.
+	if (!globalSilence)
+	{
+		printf("The display gamma will be changed repeatedly for about 4 seconds, then restored.\n");
+		printf("Press Ctrl+C within 3 seconds to cancel.\n");
+		fflush(stdout);
+		sleep(3);
+	}
+	GammaRamp direct, shell;
+	direct.open();
+	shell.open(GammaRamp::BACKEND_XGAMMA);
+	GammaRamp* backends[2] = { &direct, &shell };
+	for (int loop = 0; loop < 2; loop++)
+	{
+		struct timespec start, now;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		double elapsed = 0;
+		long applies = 0;
+		while (elapsed < 2.0)
 		{
-			menu1sliders[3]->SetSliderValue(menu1sliders[3]->GetSliderValue() - 1);
+			double gamma = (applies & 1) ? 1.01 : 1.0;
+			backends[loop]->apply(gamma, gamma, gamma);
+			backends[loop]->sync();
+			applies++;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
 		}
-		if (menu1sliders[3]->GetSliderValue() < aTarget)
+		if (!globalSilence)
 		{
-			menu1sliders[3]->SetSliderValue(menu1sliders[3]->GetSliderValue() + 1);
+			printf("%-12s %8.0f applies per second\n", backends[loop]->getBackendName(), applies / elapsed);
 		}
-		// clean up doubles so we can get a realistic match
-		for (int loop = 0; loop < 4; loop++)
+	}
+	// Then ramp generation alone, and how far it strays from pow()
+	std::vector<unsigned short> ramp(1024);
+	for (int loop = 0; loop < 2; loop++)
+	{
+		struct timespec start, now;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		double elapsed = 0;
+		long fills = 0;
+		while (elapsed < 1.0)
 		{
-			int replaceValue = menu1sliders[loop]->GetSliderValue();
-			menu1sliders[loop]->SetSliderValue(replaceValue);
+			double gamma = 0.1 + (fills % 190) / 100.0;
+			if (loop == 0)
+			{
+				GammaCurve::fill(&ramp[0], ramp.size(), gamma);
+			}
+			else
+			{
+				GammaCurve::fillReference(&ramp[0], ramp.size(), gamma);
+			}
+			fills++;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
 		}
-		if (((int) (menu1sliders[0]->GetSliderValue())) == ((int) rTarget)
-				&& ((int) (menu1sliders[1]->GetSliderValue())) == ((int) gTarget)
-				&& ((int) (menu1sliders[2]->GetSliderValue())) == ((int) bTarget)
-				&& ((int) (menu1sliders[3]->GetSliderValue())) == ((int) aTarget))
+		if (!globalSilence)
 		{
-			gammaReset = true;
+			printf("%-12s %8.0f ramps of 1024 per second\n", (loop == 0) ? "generator" : "pow()", fills / elapsed);
 		}
-		SDL_Delay(3);
+	}
+	if (!globalSilence)
+	{
+		printf("Largest ramp difference from pow(): %d\n", GammaCurve::compareWithReference());
+	}
+	// Put back whatever the user had saved
+	if (menu1sliders[0] == NULL)
+	{
+		menu1loadRGBdefaults();
+	}
+	else
+	{
 		menu1applyRGB();
-		updateGFX();
 	}
-	wavPlayer->playWav(2);
 }
 
 int initGFX()
@@ -741,6 +929,8 @@ void mouseProcess(int x, int y, int xrel, int yrel, char mouseButLR)
 		}
 		if (mouseMoved)
 		{
+			// the user takes over from any preset glide
+			menu1transition->cancel();
 			menu1applyRGB();
 		}
 	}
@@ -788,6 +978,7 @@ void processEvents()
 	if (keystates[SDLK_LMETA] && keystates[SDLK_UP])
 	{
 		// Increase gamma
+		menu1transition->cancel();
 		menu1sliders[3]->SetSliderValue(menu1sliders[3]->GetSliderValue() + 1);
 		menu1applyRGB();
 		SDL_Delay(50);
@@ -795,6 +986,7 @@ void processEvents()
 	if (keystates[SDLK_LMETA] && keystates[SDLK_DOWN])
 	{
 		// Decrease gamma
+		menu1transition->cancel();
 		menu1sliders[3]->SetSliderValue(menu1sliders[3]->GetSliderValue() - 1);
 		menu1applyRGB();
 		SDL_Delay(50);
@@ -942,61 +1134,117 @@ void drawMenu2Page()
 
 void drawMenu3Page()
 {
-	weatherDataValid = weatherDataGrabber->isDataValid();
+	/*
+	 * Safe to call every frame: WeatherData only starts a fetch when the
+	 * forecast is stale or a retry is due, and backs off while offline.
+	 * If we are on the weather tab without an internet connection, it
+	 * retries as soon as a network route appears. WeatherLocations keeps
+	 * the number of fetches running at once within its limit.
+	 */
+	weatherLocations->refresh();
+	const WeatherLocations::FORECAST_TABLE& forecasts = weatherLocations->getTable();
+	std::vector<size_t> available;
+	for (size_t location = 0; location < forecasts.generation.size(); location++)
+	{
+		if (forecasts.generation[location] != 0)
+		{
+			available.push_back(location);
+		}
+	}
+	weatherDataValid = !available.empty();
 	if (!weatherDataValid)
 	{
 		// something went wrong with data fetch...
 		outputText(30, 70, "Failed to fetch weather data", 255, 60, 60, true);
 		outputText(60, 90, "trying to connect...", 255, 60, 60, true);
-		/*
-		 * now, calling updateWeatherData spawns a thread, and we
-		 * don't want to spawn 100s of threads, so update at most once every 5 seconds.
-		 * This way, if we are on the weather tab without an internet connection,
-		 * it should automatically update with weather data shortly after
-		 * re-establishing an internet connection.
-		 */
-		time_t seconds = time(NULL);
-		if (seconds % 5 == 0)
-		{
-			weatherDataGrabber->updateWeatherData(weatherXML);
-		}
 	}
 	else
 	{
 		int linePos = 60;
 		int lineStep = 10;
 		int blue = 255;
+		size_t shown = available[(SDL_GetTicks() / WEATHER_CYCLE) % available.size()];
+		if (forecasts.locationName.size() > 1)
+		{
+			outputText(150, linePos, forecasts.locationName[shown], 180, 180, 180, false);
+		}
 		for (int thisDay = 0; thisDay < 3; thisDay++)
 		{
+			size_t row = shown * 3 + thisDay;
 			if (thisDay != 0)
 			{
 				blue = 0;
 			}
-			outputText(20, linePos, to_string(weatherDataGrabber->day[thisDay].day), 255, 255, blue, false);
+			outputText(20, linePos, forecasts.day[row], 255, 255, blue, false);
 			linePos += lineStep;
-			outputText(20, linePos, to_string(weatherDataGrabber->day[thisDay].description), 255, 255, blue,
-					false);
+			outputText(20, linePos, forecasts.description[row], 255, 255, blue, false);
 			linePos += lineStep;
-			outputText(
-					20,
-					linePos,
-					"Hi : " + to_string(weatherDataGrabber->day[thisDay].maxTemp) + "C     Lo : "
-							+ to_string(weatherDataGrabber->day[thisDay].minTemp) + "C", 255, 255, blue,
-					false);
+			outputText(20, linePos, "Hi : " + to_string(forecasts.maxTemp[row]) + "C     Lo : "
+					+ to_string(forecasts.minTemp[row]) + "C", 255, 255, blue, false);
 			linePos += lineStep;
-			outputText(
-					20,
-					linePos,
-					"Wind : " + to_string(weatherDataGrabber->day[thisDay].windDirection) + " at "
-							+ to_string(weatherDataGrabber->day[thisDay].windSpeed) + "mph", 255, 255, blue,
-					false);
+			outputText(20, linePos, "Wind : " + forecasts.windDirection[row] + " at " + to_string(
+					forecasts.windSpeed[row]) + "mph", 255, 255, blue, false);
 			linePos += lineStep;
 			linePos += lineStep;
 		}
+		drawForecastTrend(weatherLocations->getLocation(shown)->getHistory(), 20, 204, 200, 18);
 	}
 	SDL_Flip(screen);
 }
 
+/*
+ * Sparkline of today's forecast high (red) and low (blue) over the recent
+ * fetches, oldest on the left, read straight from the history ring. Both
+ * share one vertical scale, filling the given box.
+ */
+void drawForecastTrend(ForecastHistory* history, int left, int top, int width, int height)
+{
+	const size_t pointSpacing = 4; // pixels
+	int maxima[64];
+	int minima[64];
+	size_t maxPoints = std::min((size_t) (width / pointSpacing + 1), sizeof(maxima) / sizeof(maxima[0]));
+	size_t count = 0;
+	size_t available = history->getCount();
+	for (size_t age = 0; (age < available) && (count < maxPoints); age++)
+	{
+		ForecastHistory::RECORD record;
+		if (history->getRecord(age, record))
+		{
+			maxima[count] = record.maxTemp[0];
+			minima[count] = record.minTemp[0];
+			count++;
+		}
+	}
+	if (count < 2)
+	{
+		return; // no trend to show yet
+	}
+	int low = std::min(*std::min_element(minima, minima + count), *std::min_element(maxima, maxima + count));
+	int high = std::max(*std::max_element(maxima, maxima + count), *std::max_element(minima, minima + count));
+	int range = std::max(high - low, 1);
+	Uint32 highColour = SDL_MapRGB(screen->format, 255, 90, 60);
+	Uint32 lowColour = SDL_MapRGB(screen->format, 90, 160, 255);
+	int right = left + (int) ((count - 1) * pointSpacing);
+	if (SDL_MUSTLOCK(screen))
+	{
+		SDL_LockSurface(screen);
+	}
+	for (size_t point = 1; point < count; point++)
+	{
+		// index 0 is the newest, so draw leftwards from the right hand end
+		int x1 = right - (int) (point * pointSpacing);
+		int x2 = x1 + (int) pointSpacing;
+		draw_line(x1, top + height - (maxima[point] - low) * height / range, x2, top + height
+				- (maxima[point - 1] - low) * height / range, screen, highColour);
+		draw_line(x1, top + height - (minima[point] - low) * height / range, x2, top + height
+				- (minima[point - 1] - low) * height / range, screen, lowColour);
+	}
+	if (SDL_MUSTLOCK(screen))
+	{
+		SDL_UnlockSurface(screen);
+	}
+}
+
 void updateGFX()
 {
 	// background...
@@ -0,0 +1,466 @@
+/*
+ Copyright (C) 2011, 2012  Christopher Walker
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License version 3 as
+ published by the Free Software Foundation.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark and fuzz driver for the feed parsers. Not part of the
+ * utility itself; built on its own from this directory with
+ *
+ *   g++ -O2 -I../src ParserBench.cpp ../src/XMLParser.cpp ../src/XMLQuery.cpp
+ *       ../src/XMLScanner.cpp ../src/XMLOutputSink.cpp ../src/XMLStreamParser.cpp
+ *       ../src/ForecastDecoder.cpp ../src/RSSForecastDecoder.cpp
+ *       ../src/JSONForecastDecoder.cpp ../src/JSONScanner.cpp -pthread -o ParserBench
+ *
+ * "ParserBench" times setSource, validateXML, getTagValue, getTagCount,
+ * runQueries, hierarchyToTerminal (written to /dev/null) and the RSS
+ * decoder on generated documents: the BBC three day feed, a long shallow
+ * channel, deeply nested elements and attribute heavy tags, from 1 KB up
+ * to -max=<megabytes> (16 by default, at most 1024). Each line gives MB/s
+ * and heap allocations per call.
+ *
+ * "ParserBench -fuzz=<runs>" feeds mutated copies of the fixtures through
+ * every entry point; build with -fsanitize=address,undefined so an out of
+ * range access stops it. The same entry point serves libFuzzer: add
+ * -DPARSERBENCH_LIBFUZZER -fsanitize=fuzzer,address with clang.
+ */
+#include "XMLParser.h"
+#include "XMLQuery.h"
+#include "XMLOutputSink.h"
+#include "XMLStreamParser.h"
+#include "RSSForecastDecoder.h"
+#include "JSONForecastDecoder.h"
+#include <string>
+#include <vector>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static unsigned long allocationCount = 0;
+
+void* operator new(size_t size)
+{
+	allocationCount++;
+	void* block = malloc(size ? size : 1);
+	if (block == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* block) throw ()
+{
+	free(block);
+}
+
+void operator delete[](void* block) throw ()
+{
+	free(block);
+}
+
+void operator delete(void* block, size_t) throw ()
+{
+	free(block);
+}
+
+void operator delete[](void* block, size_t) throw ()
+{
+	free(block);
+}
+
+static const char* BBC_ITEMS[3] =
+{
+		"<item><title>Monday: Sunny Intervals, Maximum Temperature: 18\xC2\xB0""C (64\xC2\xB0""F) Minimum "
+			"Temperature: 9\xC2\xB0""C (48\xC2\xB0""F)</title><description>Maximum Temperature: 18\xC2\xB0""C "
+			"(64\xC2\xB0""F), Minimum Temperature: 9\xC2\xB0""C (48\xC2\xB0""F), Wind Direction: South Westerly, "
+			"Wind Speed: 10mph, Visibility: Good, Pressure: 1021mb, Humidity: 62%</description>"
+			"<link>http://www.bbc.co.uk/weather/2643743</link><pubDate>Mon, 14 May 2012 04:00:00 GMT</pubDate>"
+			"<guid isPermaLink=\"false\">http://www.bbc.co.uk/weather/2643743-0</guid></item>\n",
+		"<item><title>Tuesday: Light Rain, Maximum Temperature: 15\xC2\xB0""C (59\xC2\xB0""F) Minimum "
+			"Temperature: 8\xC2\xB0""C (46\xC2\xB0""F)</title><description>Maximum Temperature: 15\xC2\xB0""C "
+			"(59\xC2\xB0""F), Minimum Temperature: 8\xC2\xB0""C (46\xC2\xB0""F), Wind Direction: Westerly, "
+			"Wind Speed: 14mph, Visibility: Moderate, Pressure: 1012mb, Humidity: 81%</description>"
+			"<link>http://www.bbc.co.uk/weather/2643743</link><pubDate>Mon, 14 May 2012 04:00:00 GMT</pubDate>"
+			"<guid isPermaLink=\"false\">http://www.bbc.co.uk/weather/2643743-1</guid></item>\n",
+		"<item><title>Wednesday: Cloudy, Maximum Temperature: 16\xC2\xB0""C (61\xC2\xB0""F) Minimum "
+			"Temperature: 7\xC2\xB0""C (45\xC2\xB0""F)</title><description>Maximum Temperature: 16\xC2\xB0""C "
+			"(61\xC2\xB0""F), Minimum Temperature: 7\xC2\xB0""C (45\xC2\xB0""F), Wind Direction: Northerly, "
+			"Wind Speed: 6mph, Visibility: Very Good, Pressure: 1018mb, Humidity: 70%</description>"
+			"<link>http://www.bbc.co.uk/weather/2643743</link><pubDate>Mon, 14 May 2012 04:00:00 GMT</pubDate>"
+			"<guid isPermaLink=\"false\">http://www.bbc.co.uk/weather/2643743-2</guid></item>\n"
+};
+
+static const char* BBC_HEAD = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<rss version=\"2.0\" xmlns:atom=\"http://www.w3.org/2005/Atom\"><channel>"
+	"<title>BBC Weather - Forecast for  London, United Kingdom</title>"
+	"<link>http://www.bbc.co.uk/weather/2643743</link>"
+	"<description>3-day forecast for London from BBC Weather, including weather, temperature and wind "
+	"information</description><language>en</language><ttl>30</ttl>"
+	"<image><title>BBC Weather - Forecast for  London, United Kingdom</title>"
+	"<url>http://static.bbc.co.uk/weather/0.3.203/images/icons/individual_57_icons/en_on_light_bg/3.gif</url>"
+	"<link>http://www.bbc.co.uk/weather/2643743</link></image>\n";
+
+static const char* BBC_TAIL = "</channel></rss>\n";
+
+/*
+ * The feed shape: the three BBC items, then more of the same until the
+ * document reaches 'size'.
+ */
+static std::string makeBBC(size_t size)
+{
+	std::string document = BBC_HEAD;
+	for (size_t item = 0; (item < 3) || (document.length() + strlen(BBC_TAIL) < size); item++)
+	{
+		document += BBC_ITEMS[item % 3];
+	}
+	return document + BBC_TAIL;
+}
+
+// One channel with many small items, as a long news feed would have.
+static std::string makeShallow(size_t size)
+{
+	std::string document = "<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel><title>Shallow</title>\n";
+	char item[160];
+	for (unsigned long count = 0; document.length() < size; count++)
+	{
+		snprintf(item, sizeof(item), "<item><title>Item %lu</title><description>Entry number %lu of the "
+			"channel</description></item>\n", count, count);
+		document += item;
+	}
+	return document + "</channel></rss>\n";
+}
+
+// Runs of elements nested 200 deep, each level carrying a little text.
+static std::string makeNested(size_t size)
+{
+	const int depth = 200;
+	std::string document = "<?xml version=\"1.0\"?>\n<root>";
+	while (document.length() < size)
+	{
+		for (int level = 0; level < depth; level++)
+		{
+			document += "<level>text ";
+		}
+		for (int level = 0; level < depth; level++)
+		{
+			document += "</level>";
+		}
+		document += "\n";
+	}
+	return document + "</root>\n";
+}
+
+// Tags carrying many attributes, with little text between them.
+static std::string makeAttributes(size_t size)
+{
+	std::string document = "<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel>\n";
+	char item[400];
+	for (unsigned long count = 0; document.length() < size; count++)
+	{
+		snprintf(item, sizeof(item), "<item id=\"%lu\" lang=\"en\" region=\"south-east\" source=\"station-%lu\" "
+			"units=\"metric\" updated=\"2012-05-14T04:00:00Z\" quality=\"good\"><title kind=\"summary\" "
+			"short=\"yes\">Item %lu</title><value a=\"1\" b=\"2\" c=\"3\" d=\"4\" e=\"5\"/></item>\n", count,
+				count % 97, count);
+		document += item;
+	}
+	return document + "</channel></rss>\n";
+}
+
+static double nowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+enum Operation
+{
+	OP_SET_SOURCE, OP_VALIDATE, OP_TAG_VALUE, OP_TAG_COUNT, OP_QUERIES, OP_HIERARCHY, OP_RSS_DECODE, OP_COUNT
+};
+
+static const char* OPERATION_NAMES[OP_COUNT] =
+{
+		"setSource", "validateXML", "getTagValue", "getTagCount", "runQueries", "hierarchyToTerminal", "RSS decode"
+};
+
+/*
+ * Runs 'operation' once on a freshly loaded parser, so any index it
+ * builds on first use is part of the cost. Only the operation itself is
+ * timed and counted.
+ */
+static void runOnce(Operation operation, const std::string& document, double& seconds, unsigned long& allocations)
+{
+	XMLParser parser;
+	std::string error;
+	std::vector<XMLQuery*> queries;
+	XMLQuery titles("rss/channel/item[*]/title");
+	XMLQuery descriptions("rss/channel/item[*]/description");
+	queries.push_back(&titles);
+	queries.push_back(&descriptions);
+	RSSForecastDecoder decoder;
+	ForecastDecoder::FORECAST day[3];
+	int savedStdout = -1;
+	if (operation != OP_SET_SOURCE)
+	{
+		parser.setSource(document);
+	}
+	if (operation == OP_HIERARCHY)
+	{
+		fflush(stdout);
+		savedStdout = dup(STDOUT_FILENO);
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDOUT_FILENO);
+		close(devNull);
+	}
+	unsigned long allocationsBefore = allocationCount;
+	double start = nowSeconds();
+	switch (operation)
+	{
+		case OP_SET_SOURCE:
+			parser.setSource(document);
+			break;
+		case OP_VALIDATE:
+			parser.validateXML(error);
+			break;
+		case OP_TAG_VALUE:
+			parser.getTagValue("title", 2);
+			break;
+		case OP_TAG_COUNT:
+			parser.getTagCount("title");
+			break;
+		case OP_QUERIES:
+			parser.runQueries(queries);
+			break;
+		case OP_HIERARCHY:
+			parser.hierarchyToTerminal();
+			break;
+		case OP_RSS_DECODE:
+			decoder.decode(document.data(), document.length(), day);
+			break;
+		default:
+			break;
+	}
+	seconds = nowSeconds() - start;
+	allocations = allocationCount - allocationsBefore;
+	if (savedStdout != -1)
+	{
+		dup2(savedStdout, STDOUT_FILENO);
+		close(savedStdout);
+	}
+}
+
+static void benchmark(const char* shape, const std::string& document)
+{
+	for (int operation = 0; operation < OP_COUNT; operation++)
+	{
+		double total = 0;
+		unsigned long allocations = 0;
+		int runs = 0;
+		// enough runs for a quarter of a second, but at least one
+		while ((runs == 0) || ((total < 0.25) && (runs < 1000)))
+		{
+			double seconds;
+			runOnce((Operation) operation, document, seconds, allocations);
+			total += seconds;
+			runs++;
+		}
+		printf("%-10s %10lu bytes  %-20s %10.1f MB/s  %8lu allocations\n", shape, (unsigned long) document.length(),
+				OPERATION_NAMES[operation], (document.length() * runs) / (total * 1e6), allocations);
+	}
+}
+
+class NullListener: public XMLStreamListener
+{
+	public:
+		virtual void openTag(XMLSpan)
+		{
+		}
+		virtual void closeTag(XMLSpan)
+		{
+		}
+		virtual void text(XMLSpan)
+		{
+		}
+};
+
+/*
+ * Every parser entry point on one input. Results are thrown away: only
+ * a crash, or a sanitizer report, counts as a failure.
+ */
+static void fuzzOne(const char* data, size_t length)
+{
+	std::string document(data, length);
+	std::string error;
+	XMLParser parser;
+	parser.setSource(document);
+	parser.validateXML(error);
+	parser.validateXMLParallel(error, 2);
+	parser.getTagCount("item");
+	parser.getTagValue("title", 1);
+	parser.getTagValue("title", 3);
+	parser.getTagSpan("description", 2);
+	XMLQuery titles("rss/channel/item[*]/title");
+	XMLQuery second("rss/channel/item[2]/description");
+	std::vector<XMLQuery*> queries;
+	queries.push_back(&titles);
+	queries.push_back(&second);
+	parser.runQueries(queries);
+	std::string hierarchy;
+	{
+		XMLOutputSink sink(&hierarchy);
+		parser.writeHierarchy(sink, XMLParser::HIERARCHY_JSON);
+	}
+	ForecastDecoder::FORECAST day[3];
+	RSSForecastDecoder rss;
+	if (rss.accepts("", data, length))
+	{
+		rss.decode(data, length, day);
+	}
+	if (rss.beginStream("", data, length / 2))
+	{
+		rss.feedStream(data + length / 2, length - length / 2);
+		rss.finishStream(day);
+	}
+	JSONForecastDecoder json;
+	json.decode(data, length, day);
+	NullListener listener;
+	XMLStreamParser stream(&listener);
+	for (size_t pos = 0; pos < length; pos += 7)
+	{
+		stream.feed(data + pos, (length - pos < 7) ? length - pos : 7);
+	}
+	stream.finish(error);
+}
+
+#ifdef PARSERBENCH_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char* data, size_t length)
+{
+	fuzzOne((const char*) data, length);
+	return 0;
+}
+
+#else
+
+/*
+ * A cheap stand-in for libFuzzer: flips, deletes, duplicates and
+ * truncates pieces of the fixtures, which is enough to reach the error
+ * paths of a hand written parser.
+ */
+static std::string mutate(const std::string& seed, unsigned int& state)
+{
+	static const char MARKUP[] = "<>/?!=\"' \n&";
+	std::string input = seed;
+	int edits = 1 + rand_r(&state) % 8;
+	for (int edit = 0; (edit < edits) && !input.empty(); edit++)
+	{
+		size_t pos = rand_r(&state) % input.length();
+		size_t span = 1 + rand_r(&state) % 16;
+		switch (rand_r(&state) % 5)
+		{
+			case 0:
+				input[pos] = MARKUP[rand_r(&state) % (sizeof(MARKUP) - 1)];
+				break;
+			case 1:
+				input.erase(pos, span);
+				break;
+			case 2:
+				input.insert(pos, input.substr(pos, span));
+				break;
+			case 3:
+				input.resize(pos);
+				break;
+			default:
+				input[pos] = (char) rand_r(&state);
+				break;
+		}
+	}
+	return input;
+}
+
+static void fuzz(unsigned long runs)
+{
+	std::vector<std::string> seeds;
+	seeds.push_back(makeBBC(0));
+	seeds.push_back(makeShallow(512));
+	seeds.push_back(makeNested(1));
+	seeds.push_back(makeAttributes(1024));
+	seeds.push_back("{\"daily\":{\"time\":[\"2012-05-14\",\"2012-05-15\",\"2012-05-16\"],"
+		"\"weather_code\":[1,61,3],\"temperature_2m_max\":[18,15,16],\"temperature_2m_min\":[9,8,7],"
+		"\"wind_speed_10m_max\":[16,22,9],\"wind_direction_10m_dominant\":[225,270,0]}}");
+	seeds.push_back("");
+	seeds.push_back("<");
+	seeds.push_back("<a><!-- <b> --></a><?x");
+	unsigned int state = (unsigned int) time(NULL) ^ getpid();
+	printf("Fuzzing %lu inputs, seed %u\n", runs, state);
+	for (unsigned long run = 0; run < runs; run++)
+	{
+		std::string input = mutate(seeds[run % seeds.size()], state);
+		fuzzOne(input.data(), input.length());
+	}
+	printf("No failures\n");
+}
+
+int main(int argc, char* argv[])
+{
+	size_t maxMegabytes = 16;
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (strncmp(argv[arg], "-fuzz=", 6) == 0)
+		{
+			fuzz(strtoul(argv[arg] + 6, NULL, 10));
+			return 0;
+		}
+		if (strncmp(argv[arg], "-max=", 5) == 0)
+		{
+			maxMegabytes = strtoul(argv[arg] + 5, NULL, 10);
+		}
+		else
+		{
+			printf("Usage: %s [-max=<megabytes>] | [-fuzz=<runs>]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (maxMegabytes > 1024)
+	{
+		maxMegabytes = 1024;
+	}
+	const size_t sizes[] =
+	{ 1 << 10, 64 << 10, 1 << 20, 16 << 20, 256 << 20, 1 << 30 };
+	for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++)
+	{
+		if (sizes[size] > maxMegabytes << 20)
+		{
+			break;
+		}
+		benchmark("bbc", makeBBC(sizes[size]));
+		benchmark("shallow", makeShallow(sizes[size]));
+		benchmark("nested", makeNested(sizes[size]));
+		benchmark("attributes", makeAttributes(sizes[size]));
+		printf("\n");
+	}
+	return 0;
+}
+
+#endif